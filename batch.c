@@ -0,0 +1,580 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include "batch.h"
+#include "cli_utils.h"
+#include "snapshot.h"
+#include "import.h"
+#include "journal.h"
+#include "search.h"
+#include "topk.h"
+#include "filter.h"
+#include "parallel.h"
+#include "shared.h"
+#include "export.h"
+#include "stats.h"
+
+// Output protocol: every command ends with exactly one "ok[ payload]" or
+// "err <message>" line; display prints one tab-separated record per book first
+
+// ============= OUTPUT HELPERS =============
+
+static int reportOk(FILE *out, const char *payload){
+    if (payload && *payload) fprintf(out, "ok %s\n", payload);
+    else fputs("ok\n", out);
+    return BATCH_OK;
+}
+
+static int reportError(FILE *out, const char *message){
+    fprintf(out, "err %s\n", message && *message ? message : "failed");
+    return BATCH_ERROR;
+}
+
+static int reportStatus(FILE *out, BookStatus status, long isbn){
+    if (status == BOOK_OK) return reportOk(out, NULL);
+    char message[128];
+    formatStatus(status, isbn, message, sizeof(message));
+    return reportError(out, message);
+}
+
+// Keeps records on one line whatever the title contains
+static void putField(FILE *out, const char *text){
+    for (; *text; text++){
+        putc(*text == '\t' || *text == '\n' || *text == '\r' ? ' ' : *text, out);
+    }
+}
+
+static void putRecord(FILE *out, const Library *lib, const Book *book){
+    fprintf(out, "%ld\t%g\t", book->isbn, book->rating);
+    putField(out, bookTitle(lib, book));
+    putc('\t', out);
+    putField(out, bookAuthor(lib, book));
+    putc('\n', out);
+}
+
+// ============= ARGUMENT PARSING =============
+
+static char* nextToken(char **rest){
+    char *p = *rest;
+    while (*p == ' ' || *p == '\t') p++;
+    if (!*p) return NULL;
+    char *start = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+    if (*p) *p++ = '\0';
+    *rest = p;
+    return start;
+}
+
+// Remainder of the line with surrounding blanks removed, for paths and CSV rows
+static char* restOfLine(char *rest){
+    while (*rest == ' ' || *rest == '\t') rest++;
+    char *end = rest + strlen(rest);
+    while (end > rest && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+    return rest;
+}
+
+// Maps main|high|low or a bucket letter onto getCurrentList choices; high and
+// low are the first and last buckets. 0 if unknown.
+static char parseListName(const Library *lib, const char *name){
+    if (strcmp(name, "main") == 0) return 'm';
+    if (strcmp(name, "high") == 0) return 'a';
+    if (strcmp(name, "low") == 0) return (char)('a' + lib->bucket_count - 1);
+    if (name[0] && !name[1] && isListChoice(lib, name[0])) return name[0];
+    return 0;
+}
+
+static int parseIsbnArg(const char *text, long *isbn){
+    if (!text) return 0;
+    char *end;
+    errno = 0;
+    *isbn = strtol(text, &end, 10);
+    return end != text && !*end && errno != ERANGE;
+}
+
+static int parseCountArg(const char *text, size_t *count){
+    if (!text || *text == '-') return 0;
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    *count = (size_t)value;
+    return end != text && !*end && errno != ERANGE && value == *count;
+}
+
+// ============= COMMANDS =============
+
+static int cmdAdd(Library *lib, char *args, FILE *out){
+    char *row_text = restOfLine(args);
+    ImportRow row;
+    const char *err = parseCsvRow(row_text, row_text + strlen(row_text), &row);
+    if (err) return reportError(out, err);
+
+    BookStatus status = addBook(lib, row.title, row.author, row.isbn, row.rating);
+    if (status != BOOK_OK) return reportStatus(out, status, row.isbn);
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%ld", row.isbn);
+    return reportOk(out, payload);
+}
+
+// Resolves an explicit list argument, or the list that currently holds isbn
+static char listForIsbn(Library *lib, const char *name, long isbn){
+    if (name) return parseListName(lib, name);
+    Book *book = lookupBook(lib, isbn);
+    return book ? listChoiceOf(lib, book) : 'm';
+}
+
+static int cmdFind(Library *lib, char *args, FILE *out){
+    long isbn;
+    if (!parseIsbnArg(nextToken(&args), &isbn)) return reportError(out, "usage: find <isbn> [main|high|low]");
+    char choice = listForIsbn(lib, nextToken(&args), isbn);
+    if (!choice) return reportError(out, "unknown list");
+
+    Book *book = findBook(lib, choice, isbn);
+    if (!book) return reportStatus(out, BOOK_NOT_FOUND, isbn);
+    putRecord(out, lib, book);
+    return reportOk(out, "1");
+}
+
+static int cmdDelete(Library *lib, char *args, FILE *out){
+    long isbn;
+    if (!parseIsbnArg(nextToken(&args), &isbn)) return reportError(out, "usage: delete <isbn> [main|high|low]");
+    char choice = listForIsbn(lib, nextToken(&args), isbn);
+    if (!choice) return reportError(out, "unknown list");
+
+    return reportStatus(out, deleteBookByISBN(lib, choice, isbn), isbn);
+}
+
+// Payload: the kind of step undone
+static int cmdUndo(Library *lib, FILE *out){
+    const char *step = nextUndoName(lib);
+    BookStatus status = undoLastChange(lib);
+    if (status != BOOK_OK) return reportStatus(out, status, 0);
+    return reportOk(out, step);
+}
+
+// Explicit list argument, or main_list while not split; 0 when ambiguous
+static char listArgument(Library *lib, char **args, FILE *out){
+    char *name = nextToken(args);
+    if (!name){
+        if (!lib->is_split) return 'm';
+        reportError(out, "library is split: name a list (high|low|a-z)");
+        return 0;
+    }
+    char choice = parseListName(lib, name);
+    if (!choice) reportError(out, "unknown list");
+    return choice;
+}
+
+// display [list] [offset [limit]]; a list name never starts with a digit.
+// The session's cursor remembers where the last page ended, so asking for the
+// next page walks only the books in between instead of starting over.
+static int cmdDisplay(Library *lib, BookCursor *cursor, char *args, FILE *out){
+    char *token = nextToken(&args);
+    char choice = 'm';
+    if (token && (*token < '0' || *token > '9')){
+        choice = parseListName(lib, token);
+        if (!choice) return reportError(out, "unknown list");
+        token = nextToken(&args);
+    }
+    else if (lib->is_split){
+        return reportError(out, "library is split: name a list (high|low|a-z)");
+    }
+
+    size_t offset = 0, limit = SIZE_MAX;
+    if (token && !parseCountArg(token, &offset)) return reportError(out, "usage: display [list] [offset [limit]]");
+    token = nextToken(&args);
+    if (token && !parseCountArg(token, &limit)) return reportError(out, "usage: display [list] [offset [limit]]");
+
+    if (cursor->list != getCurrentList(lib, choice)) cursorOpen(cursor, lib, choice);
+    cursorSeek(cursor, lib, offset);
+    size_t shown = exportBooks(lib, cursor, limit, EXPORT_TSV, out);
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", shown);
+    return reportOk(out, payload);
+}
+
+static int cmdSort(Library *lib, char *args, FILE *out){
+    char choice = listArgument(lib, &args, out);
+    if (!choice) return BATCH_ERROR;
+    return reportStatus(out, sortByRating(lib, choice), 0);
+}
+
+static int cmdFree(Library *lib, char *args, FILE *out){
+    char choice = listArgument(lib, &args, out);
+    if (!choice) return BATCH_ERROR;
+    return reportStatus(out, freeLibraryList(lib, choice), 0);
+}
+
+// count/avg default to the whole library when no list is named
+static int cmdStats(Library *lib, char *args, FILE *out, int average){
+    size_t count;
+    RatingSum sum;
+    char *name = nextToken(&args);
+    if (name){
+        char choice = parseListName(lib, name);
+        if (!choice) return reportError(out, "unknown list");
+        BookList *list = getCurrentList(lib, choice);
+        count = countBooks(list);
+        sum = list->rating_sum;
+    }
+    else{
+        count = countBooks(&lib->main_list);
+        sum = lib->main_list.rating_sum;
+        for (int i = 0; i < lib->bucket_count; i++){
+            count += countBooks(&lib->buckets[i]);
+            sum += lib->buckets[i].rating_sum;
+        }
+    }
+
+    char payload[64];
+    if (average) snprintf(payload, sizeof(payload), "%.4f %zu", meanRating(sum, count), count);
+    else snprintf(payload, sizeof(payload), "%zu", count);
+    return reportOk(out, payload);
+}
+
+static int cmdSearch(Library *lib, char *args, FILE *out){
+    static const char usage[] = "usage: search prefix|contains title|author|any all|main|high|low <text>";
+    char *mode = nextToken(&args), *field = nextToken(&args), *list = nextToken(&args);
+    char *text = restOfLine(args);
+    if (!list || !*text) return reportError(out, usage);
+
+    SearchMode search_mode;
+    if (strcmp(mode, "prefix") == 0) search_mode = SEARCH_PREFIX;
+    else if (strcmp(mode, "contains") == 0) search_mode = SEARCH_SUBSTRING;
+    else return reportError(out, usage);
+
+    SearchField fields;
+    if (strcmp(field, "title") == 0) fields = SEARCH_TITLE;
+    else if (strcmp(field, "author") == 0) fields = SEARCH_AUTHOR;
+    else if (strcmp(field, "any") == 0) fields = SEARCH_ANY;
+    else return reportError(out, usage);
+
+    char choice = 0;
+    if (strcmp(list, "all") != 0 && !(choice = parseListName(lib, list))) return reportError(out, "unknown list");
+
+    Book **books;
+    size_t count;
+    if (!searchBooks(lib, choice, text, search_mode, fields, &books, &count)){
+        return reportError(out, "Memory allocation failed!");
+    }
+    for (size_t i = 0; i < count; i++) putRecord(out, lib, books[i]);
+    free(books);
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", count);
+    return reportOk(out, payload);
+}
+
+static int parseRatingArg(const char *text, float *rating){
+    if (!text) return 0;
+    char *end;
+    *rating = strtof(text, &end);
+    return end != text && !*end && !isnan(*rating);
+}
+
+static int cmdRange(Library *lib, char *args, FILE *out){
+    float lo, hi;
+    if (!parseRatingArg(nextToken(&args), &lo) || !parseRatingArg(nextToken(&args), &hi)){
+        return reportError(out, "usage: range <lo> <hi>");
+    }
+
+    Book **books;
+    size_t count;
+    if (!booksInRatingRange(lib, lo, hi, &books, &count)) return reportError(out, "Memory allocation failed!");
+    for (size_t i = 0; i < count; i++) putRecord(out, lib, books[i]);
+    free(books);
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", count);
+    return reportOk(out, payload);
+}
+
+static int cmdTop(Library *lib, char *args, FILE *out, int highest){
+    size_t k;
+    if (!parseCountArg(nextToken(&args), &k)){
+        return reportError(out, highest ? "usage: top <k> [all|main|high|low]" : "usage: bottom <k> [all|main|high|low]");
+    }
+    char *list = nextToken(&args);
+    char choice = 0;
+    if (list && strcmp(list, "all") != 0 && !(choice = parseListName(lib, list))) return reportError(out, "unknown list");
+
+    Book **books;
+    size_t count;
+    if (!topRatedBooks(lib, choice, k, highest, &books, &count)) return reportError(out, "Memory allocation failed!");
+    for (size_t i = 0; i < count; i++) putRecord(out, lib, books[i]);
+    free(books);
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", count);
+    return reportOk(out, payload);
+}
+
+// With no argument prints the cached k; 0 turns the cache off
+static int cmdTopCache(Library *lib, char *args, FILE *out){
+    char *token = nextToken(&args);
+    size_t k;
+    if (token){
+        if (!parseCountArg(token, &k)) return reportError(out, "usage: topcache [k]");
+        if (!setTopCache(lib, k)) return reportError(out, "Memory allocation failed!");
+    }
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", topCacheSize(lib));
+    return reportOk(out, payload);
+}
+
+// filter [on|off]: prints "off", or "bytes live stale checks skipped
+// false_positives observed_fpr expected_fpr"
+static int cmdFilter(Library *lib, char *args, FILE *out){
+    char *token = nextToken(&args);
+    if (token){
+        if (strcmp(token, "on") != 0 && strcmp(token, "off") != 0) return reportError(out, "usage: filter [on|off]");
+        if (!setIsbnFilter(lib, strcmp(token, "on") == 0)) return reportError(out, "Memory allocation failed!");
+    }
+    if (!isbnFilterEnabled(lib)) return reportOk(out, "off");
+
+    IsbnFilterStats stats;
+    readIsbnFilterStats(lib, &stats);
+    char payload[192];
+    snprintf(payload, sizeof(payload), "%zu %zu %zu %llu %llu %llu %.6f %.6f", stats.bytes, stats.keys - stats.stale,
+             stats.stale, (unsigned long long)stats.checks, (unsigned long long)stats.skipped,
+             (unsigned long long)stats.false_positives, stats.observed_fpr, stats.expected_fpr);
+    return reportOk(out, payload);
+}
+
+// defrag [min_pct]: prints "books jumps_before jumps_after bytes_reclaimed
+// walk_ns_before walk_ns_after", or "skipped books jumps" when fewer than
+// min_pct percent of the links jump
+static int cmdDefrag(Library *lib, char *args, FILE *out){
+    char *token = nextToken(&args);
+    size_t min_pct = 0;
+    if (token && (!parseCountArg(token, &min_pct) || min_pct > 100)) return reportError(out, "usage: defrag [min_pct]");
+
+    BookLayout before, after;
+    char payload[160];
+    measureBookLayout(lib, &before);
+    if (before.jumps * 100 < min_pct * before.books){
+        snprintf(payload, sizeof(payload), "skipped %zu %zu", before.books, before.jumps);
+        return reportOk(out, payload);
+    }
+    BookStatus status = defragmentBooks(lib);
+    if (status != BOOK_OK) return reportStatus(out, status, 0);
+    measureBookLayout(lib, &after);
+    snprintf(payload, sizeof(payload), "%zu %zu %zu %zu %llu %llu", before.books, before.jumps, after.jumps,
+             before.pool_bytes + before.string_bytes - after.pool_bytes - after.string_bytes,
+             (unsigned long long)before.walk_ns,
+             (unsigned long long)after.walk_ns);
+    return reportOk(out, payload);
+}
+
+// With no argument prints the worker count; 0 means one per CPU
+static int cmdThreads(char *args, FILE *out){
+    char *token = nextToken(&args);
+    size_t count;
+    if (token){
+        if (!parseCountArg(token, &count)) return reportError(out, "usage: threads [n]");
+        if (!setWorkerThreads(count ? (int)(count < MAX_WORKERS ? count : MAX_WORKERS) : onlineCpus())){
+            return reportError(out, "could not start worker threads");
+        }
+    }
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%d", workerThreads());
+    return reportOk(out, payload);
+}
+
+// stats: one "op calls mean_ns p50_ns p99_ns max_ns bytes" line per operation
+// that ran; stats json: the full dump on one line; stats reset: start over
+static int cmdStatsDump(char *args, FILE *out){
+    char *mode = nextToken(&args);
+    if (!statsEnabled()) return reportError(out, "statistics were compiled out (BOOK_NO_STATS)");
+    if (mode && strcmp(mode, "reset") == 0){
+        resetStats();
+        return reportOk(out, NULL);
+    }
+    if (mode && strcmp(mode, "json") == 0){
+        writeStatsJson(out);
+        return reportOk(out, NULL);
+    }
+    if (mode) return reportError(out, "usage: stats [json|reset]");
+
+    int shown = 0;
+    for (int op = 0; op < STAT_OPS; op++){
+        OpStats stats;
+        readOpStats((StatOp)op, &stats);
+        if (!stats.calls) continue;
+        // A reset racing in-flight calls can leave calls counted but none timed
+        char mean[32] = "-";
+        if (stats.timed) snprintf(mean, sizeof(mean), "%.0f", (double)stats.total_ns / (double)stats.timed);
+        fprintf(out, "%s\t%llu\t%s\t%llu\t%llu\t%llu\t%llu\n", statOpName((StatOp)op),
+                (unsigned long long)stats.calls, mean,
+                (unsigned long long)statPercentile(&stats, 0.50), (unsigned long long)statPercentile(&stats, 0.99),
+                (unsigned long long)stats.max_ns, (unsigned long long)stats.bytes);
+        shown++;
+    }
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%d", shown);
+    return reportOk(out, payload);
+}
+
+// With no arguments prints the current cuts, highest first
+static int cmdBuckets(Library *lib, char *args, FILE *out){
+    float cuts[MAX_BUCKETS - 1];
+    int count = 0;
+    char *token;
+    while ((token = nextToken(&args))){
+        if (count == MAX_BUCKETS - 1 || !parseRatingArg(token, &cuts[count])){
+            return reportError(out, "usage: buckets [cut...]");
+        }
+        count++;
+    }
+    BookStatus status = count ? setRatingBuckets(lib, cuts, count) : BOOK_OK;
+    if (status != BOOK_OK) return reportStatus(out, status, 0);
+
+    char payload[MAX_BUCKETS * 16] = "";
+    size_t used = 0;
+    for (int i = 0; i < lib->bucket_count - 1; i++){
+        used += (size_t)snprintf(payload + used, sizeof(payload) - used, i ? " %g" : "%g", lib->cuts[i]);
+    }
+    return reportOk(out, payload);
+}
+
+// export <plain|tsv|csv|json> <file> [list]; the whole library when no list is named
+static int cmdExport(Library *lib, char *args, FILE *out){
+    ExportFormat format;
+    char *name = nextToken(&args), *path = nextToken(&args), *list_name = nextToken(&args);
+    if (!name || !path || !parseExportFormat(name, &format)){
+        return reportError(out, "usage: export plain|tsv|csv|json <file> [list]");
+    }
+    char choice = 0;
+    if (list_name && !(choice = parseListName(lib, list_name))) return reportError(out, "unknown list");
+
+    FILE *file = fopen(path, "w");
+    if (!file) return reportError(out, "cannot open export file");
+    exportHeader(format, file);
+    size_t written = exportLibrary(lib, choice, format, file);
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    if (failed) return reportError(out, "export write failed");
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "%zu", written);
+    return reportOk(out, payload);
+}
+
+static int cmdImport(Library *lib, char *args, FILE *out){
+    char *path = restOfLine(args);
+    if (!*path) return reportError(out, "usage: import <file>");
+
+    ImportStats stats;
+    if (!importBooks(lib, path, &stats)) return reportError(out, lastMessage());
+    char payload[128];
+    snprintf(payload, sizeof(payload), "imported=%zu rejected=%zu rows_per_sec=%.0f",
+             stats.imported, stats.rejected, stats.seconds > 0.0 ? (double)stats.rows / stats.seconds : 0.0);
+    return reportOk(out, payload);
+}
+
+static int cmdSnapshot(Library *lib, char *args, FILE *out, int save){
+    char *path = restOfLine(args);
+    if (!*path) return reportError(out, save ? "usage: save <file>" : "usage: load <file>");
+    if (!(save ? saveSnapshot(lib, path) : loadSnapshot(lib, path))) return reportError(out, lastMessage());
+    return reportOk(out, NULL);
+}
+
+static int dispatchCommand(Library *lib, BatchSession *session, const char *cmd, char *args, FILE *out){
+    if (strcmp(cmd, "add") == 0) return cmdAdd(lib, args, out);
+    if (strcmp(cmd, "find") == 0) return cmdFind(lib, args, out);
+    if (strcmp(cmd, "delete") == 0) return cmdDelete(lib, args, out);
+    if (strcmp(cmd, "delete-last") == 0) return reportStatus(out, deleteLastAddedBook(lib), 0);
+    if (strcmp(cmd, "undo") == 0) return cmdUndo(lib, out);
+    if (strcmp(cmd, "display") == 0) return cmdDisplay(lib, &session->display, args, out);
+    if (strcmp(cmd, "export") == 0) return cmdExport(lib, args, out);
+    if (strcmp(cmd, "split") == 0) return reportStatus(out, splitLibrary(lib), 0);
+    if (strcmp(cmd, "merge") == 0) return reportStatus(out, mergeLibrary(lib), 0);
+    if (strcmp(cmd, "sort") == 0) return cmdSort(lib, args, out);
+    if (strcmp(cmd, "count") == 0) return cmdStats(lib, args, out, 0);
+    if (strcmp(cmd, "avg") == 0) return cmdStats(lib, args, out, 1);
+    if (strcmp(cmd, "free") == 0) return cmdFree(lib, args, out);
+    if (strcmp(cmd, "search") == 0) return cmdSearch(lib, args, out);
+    if (strcmp(cmd, "range") == 0) return cmdRange(lib, args, out);
+    if (strcmp(cmd, "buckets") == 0) return cmdBuckets(lib, args, out);
+    if (strcmp(cmd, "top") == 0) return cmdTop(lib, args, out, 1);
+    if (strcmp(cmd, "bottom") == 0) return cmdTop(lib, args, out, 0);
+    if (strcmp(cmd, "topcache") == 0) return cmdTopCache(lib, args, out);
+    if (strcmp(cmd, "filter") == 0) return cmdFilter(lib, args, out);
+    if (strcmp(cmd, "defrag") == 0) return cmdDefrag(lib, args, out);
+    if (strcmp(cmd, "threads") == 0) return cmdThreads(args, out);
+    if (strcmp(cmd, "stats") == 0) return cmdStatsDump(args, out);
+    if (strcmp(cmd, "save") == 0) return cmdSnapshot(lib, args, out, 1);
+    if (strcmp(cmd, "load") == 0) return cmdSnapshot(lib, args, out, 0);
+    if (strcmp(cmd, "import") == 0) return cmdImport(lib, args, out);
+    if (strcmp(cmd, "compact") == 0){
+        if (!compactJournal(lib)) return reportError(out, lastMessage());
+        return reportOk(out, NULL);
+    }
+    if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "exit") == 0){
+        reportOk(out, NULL);
+        return BATCH_QUIT;
+    }
+    return reportError(out, "unknown command");
+}
+
+// Commands that only walk lists and the ISBN index; the rest may build an
+// index or change the library and run in a write section
+static int isReadCommand(const char *cmd){
+    static const char *const reads[] = {"find", "display", "export", "count", "avg", "stats"};
+    for (size_t i = 0; i < sizeof(reads) / sizeof(reads[0]); i++){
+        if (strcmp(cmd, reads[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Commands that open a file named on the command line
+static int isFileCommand(const char *cmd){
+    static const char *const files[] = {"save", "load", "import", "export"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++){
+        if (strcmp(cmd, files[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+int executeCommand(Library *lib, BatchSession *session, char *line, FILE *out){
+    line[strcspn(line, "\r\n")] = '\0';
+    char *args = line;
+    char *cmd = nextToken(&args);
+    if (!cmd || cmd[0] == '#') return BATCH_OK;  // blank lines and comments
+    if (session->no_files && isFileCommand(cmd)) return reportError(out, "file commands are disabled over the server");
+
+    if (isReadCommand(cmd)) beginRead(lib);
+    else beginWrite(lib);
+    int status = dispatchCommand(lib, session, cmd, args, out);
+    endAccess(lib);
+    return status;
+}
+
+int runBatch(Library *lib, FILE *in, FILE *out){
+    char line[BATCH_MAXLINE];
+    BatchSession session = {0};
+    int all_ok = 1;
+
+    while (fgets(line, sizeof(line), in)){
+        if (!strchr(line, '\n') && !feof(in)){
+            // Overlong line: report it once and skip the remainder
+            int c;
+            while ((c = getc(in)) != EOF && c != '\n');
+            reportError(out, "line too long");
+            all_ok = 0;
+            continue;
+        }
+        int status = executeCommand(lib, &session, line, out);
+        if (lib->journal){
+            beginWrite(lib);  // the journal buffer is writer state
+            syncJournalIfDue(lib->journal);
+            endAccess(lib);
+        }
+        if (status == BATCH_QUIT) break;
+        if (status == BATCH_ERROR) all_ok = 0;
+    }
+    fflush(out);
+    return all_ok;
+}
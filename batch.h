@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "book.h"
+#include "export.h"
+
+#define BATCH_OK    1
+#define BATCH_ERROR 0
+#define BATCH_QUIT  (-1)
+
+#define BATCH_MAXLINE 4096  // longest command line, newline included
+
+// State kept for one stream of commands, e.g. one server connection
+typedef struct{
+    BookCursor display;  // where the last display page ended, so the next one does not re-walk
+    int no_files;        // refuse save, load, import and export: their paths come from a remote client
+}BatchSession;
+
+// Runs one command line and writes its result lines to out. On a shared
+// library it takes a read or write section itself, so threads may call it freely.
+int executeCommand(Library *lib, BatchSession *session, char *line, FILE *out);
+
+// Reads commands from in until EOF or "quit"; returns 1 if every command succeeded
+int runBatch(Library *lib, FILE *in, FILE *out);
+
+#endif // BATCH_H
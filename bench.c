@@ -0,0 +1,367 @@
+// Microbenchmarks for the book.c hot paths on synthetic libraries. Each size
+// runs in its own child process so peak RSS is per size, and every result is
+// one CSV row. With --shards n, n threads also ingest and look up the same
+// books in a sharded library and in one library behind a single lock. With
+// --isbn-filter 1 the library checks ISBNs through its Bloom filter.
+//   books,operation,ops,total_ns,ns_per_op,ops_per_sec,peak_rss_kb
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "book.h"
+#include "cli_utils.h"
+#include "parallel.h"
+#include "shared.h"
+#include "sharded.h"
+#include "filter.h"
+
+#define BENCH_BASE_ISBN  9780000000000L
+#define BENCH_MAX_SIZES  16
+#define BENCH_STAT_CALLS 10000000  // O(1) reads are timed over this many calls
+
+typedef struct{
+    size_t sizes[BENCH_MAX_SIZES];
+    int size_count;
+    int threads;
+    int shards;  // 0 skips the concurrent runs
+    int filter;  // build the library with its ISBN filter
+    FILE *out;
+}BenchOptions;
+
+static volatile double sink;  // keeps timed reads from being optimised away
+
+static long long nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long peakRssKb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void report(FILE *out, size_t books, const char *op, size_t ops, long long ns){
+    double per_op = ops ? (double)ns / (double)ops : 0.0;
+    fprintf(out, "%zu,%s,%zu,%lld,%.1f,%.0f,%ld\n", books, op, ops, ns, per_op,
+            ns > 0 ? (double)ops * 1e9 / (double)ns : 0.0, peakRssKb());
+    fflush(out);
+}
+
+static unsigned long long nextRandom(unsigned long long *state){
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return *state >> 33;
+}
+
+// Ratings with one decimal place, like the ones entered by hand
+static float ratingFor(unsigned long long *state){
+    return (float)(nextRandom(state) % 51) / 10.0f;
+}
+
+// Fisher-Yates shuffle of the ISBNs, so lookups and deletes hit the index and
+// the lists in random order
+static long* shuffledIsbns(size_t n, unsigned long long *state){
+    long *isbns = malloc(n * sizeof(long));
+    if (!isbns) return NULL;
+    for (size_t i = 0; i < n; i++) isbns[i] = BENCH_BASE_ISBN + (long)i;
+    for (size_t i = n; i > 1; i--){
+        size_t j = (size_t)(nextRandom(state) % i);
+        long swap = isbns[i - 1];
+        isbns[i - 1] = isbns[j];
+        isbns[j] = swap;
+    }
+    return isbns;
+}
+
+// What averageRating would cost without the running sum: one pass over the nodes
+static double walkRatings(const BookList *list){
+    double total = 0.0;
+    for (const Book *book = list->head; book; book = book->next) total += book->rating;
+    return total;
+}
+
+static int benchSize(size_t n, int filter, FILE *out){
+    unsigned long long state = 42;
+    Library *lib = createLibrary();
+    long *isbns = shuffledIsbns(n, &state);
+    if (!lib || !isbns || (filter && !setIsbnFilter(lib, 1))){
+        fprintf(stderr, "Memory allocation failed!\n");
+        return 0;
+    }
+
+    char title[64], author[64];
+    long long start = nowNs();
+    for (size_t i = 0; i < n; i++){
+        snprintf(title, sizeof(title), "Book number %zu", i);
+        snprintf(author, sizeof(author), "Author %zu", i % 5000);
+        BookStatus status = addBook(lib, title, author, BENCH_BASE_ISBN + (long)i, ratingFor(&state));
+        if (status != BOOK_OK){
+            char message[128];
+            formatStatus(status, BENCH_BASE_ISBN + (long)i, message, sizeof(message));
+            fprintf(stderr, "addBook failed at %zu: %s\n", i, message);
+            return 0;
+        }
+    }
+    report(out, n, "addBook", n, nowNs() - start);
+
+    size_t found = 0;
+    start = nowNs();
+    for (size_t i = 0; i < n; i++) found += findBook(lib, 'm', isbns[i]) != NULL;
+    report(out, n, "findBook", n, nowNs() - start);
+    if (found != n) fprintf(stderr, "findBook missed %zu books\n", n - found);
+
+    // The same ISBNs shifted past the library: every lookup misses
+    found = 0;
+    start = nowNs();
+    for (size_t i = 0; i < n; i++) found += findBook(lib, 'm', isbns[i] + (long)n) != NULL;
+    report(out, n, "findMissing", n, nowNs() - start);
+    if (found) fprintf(stderr, "findMissing found %zu books\n", found);
+    if (filter){
+        IsbnFilterStats stats;
+        readIsbnFilterStats(lib, &stats);
+        fprintf(stderr, "%zu books: ISBN filter %zu bytes, %.4f%% false positives observed, %.4f%% expected\n",
+                n, stats.bytes, stats.observed_fpr * 100.0, stats.expected_fpr * 100.0);
+    }
+
+    double total = 0.0;
+    start = nowNs();
+    for (size_t i = 0; i < BENCH_STAT_CALLS; i++) total += (double)countBooks(&lib->main_list);
+    report(out, n, "countBooks", BENCH_STAT_CALLS, nowNs() - start);
+    start = nowNs();
+    for (size_t i = 0; i < BENCH_STAT_CALLS; i++) total += averageRating(&lib->main_list);
+    report(out, n, "averageRating", BENCH_STAT_CALLS, nowNs() - start);
+    sink = total;
+
+    // One call each; ns_per_op is per book moved
+    start = nowNs();
+    sortByRating(lib, 'm');
+    report(out, n, "sortByRating", n, nowNs() - start);
+    start = nowNs();
+    splitLibrary(lib);
+    report(out, n, "splitLibrary", n, nowNs() - start);
+    start = nowNs();
+    mergeLibrary(lib);
+    report(out, n, "mergeLibrary", n, nowNs() - start);
+
+    // The sort left list order unrelated to memory order; walk it before and
+    // after relinking the nodes in list order
+    start = nowNs();
+    sink = walkRatings(&lib->main_list);
+    report(out, n, "walkScattered", n, nowNs() - start);
+    start = nowNs();
+    defragmentBooks(lib);
+    report(out, n, "defragmentBooks", n, nowNs() - start);
+    start = nowNs();
+    sink = walkRatings(&lib->main_list);
+    report(out, n, "walkDefragmented", n, nowNs() - start);
+
+    start = nowNs();
+    for (size_t i = 0; i < n; i++) deleteBookByISBN(lib, 'm', isbns[i]);
+    report(out, n, "deleteBookByISBN", n, nowNs() - start);
+
+    free(isbns);
+    destroyLibrary(lib);
+    return 1;
+}
+
+// ============= CONCURRENT INGEST =============
+
+// One thread's slice of a concurrent run: books [first, first + count) are
+// added to, or looked up in, either the sharded library or the locked one
+typedef struct{
+    ShardedLibrary *sharded;
+    Library *locked;
+    const long *isbns;
+    const float *ratings;
+    size_t first;
+    size_t count;
+    int lookup;
+    size_t failed;
+}IngestTask;
+
+static void* ingestThread(void *arg){
+    IngestTask *task = arg;
+    char title[64], author[64];
+    for (size_t i = task->first; i < task->first + task->count; i++){
+        long isbn = task->isbns[i];
+        if (task->lookup){
+            Library *shard = task->locked;
+            const Book *book;
+            if (task->sharded) book = shardedFindBook(task->sharded, isbn, &shard);
+            else{
+                beginRead(shard);
+                book = findBook(shard, 'm', isbn);
+                if (!book) endAccess(shard);
+            }
+            if (book) endAccess(shard);
+            else task->failed++;
+            continue;
+        }
+        snprintf(title, sizeof(title), "Book number %ld", isbn - BENCH_BASE_ISBN);
+        snprintf(author, sizeof(author), "Author %ld", (isbn - BENCH_BASE_ISBN) % 5000);
+        BookStatus status;
+        if (task->sharded) status = shardedAddBook(task->sharded, title, author, isbn, task->ratings[i]);
+        else{
+            beginWrite(task->locked);
+            status = addBook(task->locked, title, author, isbn, task->ratings[i]);
+            endAccess(task->locked);
+        }
+        task->failed += status != BOOK_OK;
+    }
+    return NULL;
+}
+
+// Runs threads slices of the n books at once; returns the wall time, or -1
+static long long runIngest(int threads, ShardedLibrary *sharded, Library *locked, const long *isbns,
+                           const float *ratings, size_t n, int lookup){
+    IngestTask tasks[MAX_SHARDS];
+    pthread_t ids[MAX_SHARDS];
+    size_t failed = 0;
+    int started = 0;
+    long long start = nowNs();
+    for (int t = 0; t < threads; t++){
+        size_t first = n / (size_t)threads * (size_t)t;
+        size_t count = t == threads - 1 ? n - first : n / (size_t)threads;
+        tasks[t] = (IngestTask){sharded, locked, isbns, ratings, first, count, lookup, 0};
+        if (pthread_create(&ids[t], NULL, ingestThread, &tasks[t]) != 0) break;
+        started++;
+    }
+    for (int t = 0; t < started; t++){
+        pthread_join(ids[t], NULL);
+        failed += tasks[t].failed;
+    }
+    long long ns = nowNs() - start;
+    if (started < threads || failed){
+        fprintf(stderr, "%s: %zu of %zu books failed\n", lookup ? "lookup" : "ingest", failed, n);
+        return -1;
+    }
+    return ns;
+}
+
+static int benchSharded(size_t n, int shards, FILE *out){
+    unsigned long long state = 7;
+    long *isbns = shuffledIsbns(n, &state);
+    float *ratings = malloc(n * sizeof(float));
+    ShardedLibrary *sharded = createShardedLibrary(shards);
+    Library *locked = createLibrary();
+    FILE *sink_file = fopen("/dev/null", "w");
+    if (!isbns || !ratings || !sharded || !locked || !enableSharedAccess(locked) || !sink_file){
+        fprintf(stderr, "Memory allocation failed!\n");
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) ratings[i] = ratingFor(&state);
+
+    long long ns;
+    if ((ns = runIngest(shards, NULL, locked, isbns, ratings, n, 0)) < 0) return 0;
+    report(out, n, "lockedAddBook", n, ns);
+    if ((ns = runIngest(shards, sharded, NULL, isbns, ratings, n, 0)) < 0) return 0;
+    report(out, n, "shardedAddBook", n, ns);
+    if ((ns = runIngest(shards, NULL, locked, isbns, ratings, n, 1)) < 0) return 0;
+    report(out, n, "lockedFindBook", n, ns);
+    if ((ns = runIngest(shards, sharded, NULL, isbns, ratings, n, 1)) < 0) return 0;
+    report(out, n, "shardedFindBook", n, ns);
+
+    long long start = nowNs();
+    size_t counted = 0;
+    for (int i = 0; i < 1000; i++) counted += shardedCount(sharded);
+    sink = shardedAverageRating(sharded);
+    report(out, n, "shardedCount", 1000, nowNs() - start);
+    if (counted != n * 1000) fprintf(stderr, "shardedCount saw %zu books\n", counted / 1000);
+
+    // One call each; ns_per_op is per book
+    start = nowNs();
+    shardedSortByRating(sharded);
+    report(out, n, "shardedSortByRating", n, nowNs() - start);
+    start = nowNs();
+    size_t written = shardedExport(sharded, 1, EXPORT_TSV, sink_file);
+    report(out, n, "shardedExport", written, nowNs() - start);
+
+    fclose(sink_file);
+    destroyShardedLibrary(sharded);
+    destroyLibrary(locked);
+    free(ratings);
+    free(isbns);
+    return 1;
+}
+
+static int parseSizes(const char *text, BenchOptions *opts){
+    opts->size_count = 0;
+    while (*text){
+        char *end;
+        double size = strtod(text, &end);  // accepts 1e6
+        if (end == text || size < 1 || opts->size_count == BENCH_MAX_SIZES) return 0;
+        opts->sizes[opts->size_count++] = (size_t)size;
+        text = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return 0;
+    }
+    return opts->size_count > 0;
+}
+
+static int parseOptions(int argc, char *argv[], BenchOptions *opts){
+    parseSizes("1e3,1e4,1e5,1e6", opts);
+    opts->threads = 1;
+    opts->shards = 0;
+    opts->filter = 0;
+    opts->out = stdout;
+
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc) return 0;
+        if (strcmp(argv[i], "--sizes") == 0){
+            if (!parseSizes(argv[++i], opts)) return 0;
+        }
+        else if (strcmp(argv[i], "--threads") == 0){
+            opts->threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--shards") == 0){
+            opts->shards = atoi(argv[++i]);
+            if (opts->shards < 1 || opts->shards > MAX_SHARDS) return 0;
+        }
+        else if (strcmp(argv[i], "--isbn-filter") == 0){
+            opts->filter = atoi(argv[++i]) != 0;
+        }
+        else if (strcmp(argv[i], "--out") == 0){
+            opts->out = fopen(argv[++i], "w");
+            if (!opts->out){
+                perror(argv[i]);
+                return 0;
+            }
+        }
+        else{
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]){
+    BenchOptions opts;
+    if (!parseOptions(argc, argv, &opts)){
+        fprintf(stderr, "Usage: %s [--sizes 1e3,1e4,1e5,1e6,1e7] [--threads n] [--shards n] [--isbn-filter 0|1]\n"
+                        "       [--out results.csv]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(opts.out, "books,operation,ops,total_ns,ns_per_op,ops_per_sec,peak_rss_kb\n");
+    fflush(opts.out);
+    int ok = 1;
+    for (int i = 0; i < opts.size_count; i++){
+        pid_t pid = fork();
+        if (pid == 0){
+            if (opts.threads != 1) setWorkerThreads(opts.threads ? opts.threads : onlineCpus());
+            int ok = benchSize(opts.sizes[i], opts.filter, opts.out) && (!opts.shards || benchSharded(opts.sizes[i], opts.shards, opts.out));
+            _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            fprintf(stderr, "Run with %zu books failed.\n", opts.sizes[i]);
+            ok = 0;
+        }
+    }
+    if (opts.out != stdout) fclose(opts.out);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
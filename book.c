@@ -1,379 +1,1530 @@
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "book.h"
-#include "cli_utils.h"
+#include "journal.h"
+#include "search.h"
+#include "topk.h"
+#include "filter.h"
+#include "parallel.h"
+#include "shared.h"
+#include "stats.h"
 
 // ============= LIBRARY MANAGEMENT =============
 
 Library* createLibrary(void){
     Library *lib = malloc(sizeof(Library));
-    if (!lib){
-        printError("Failed to create library!");
-        return NULL;
-    }
-    lib->main_list = NULL;
-    lib->high_rated = NULL;
-    lib->low_rated = NULL;
+    if (!lib) return NULL;
+    lib->main_list = (BookList){0};
+    for (int i = 0; i < MAX_BUCKETS; i++) lib->buckets[i] = (BookList){0};
+    lib->cuts[0] = SPLIT_RATING;
+    lib->bucket_count = 2;
+    lib->ratings = (RatingIndex){0};
     lib->last_added = NULL;  // Initialize last_added tracker
     lib->is_split = 0;
+    lib->index.slots = NULL;
+    lib->index.capacity = 0;
+    lib->index.count = 0;
+    lib->pool.chunks = NULL;
+    lib->pool.used = 0;
+    lib->pool.free_list = NULL;
+    lib->pool.live = 0;
+    lib->strings = (StringArena){0};
+    lib->search = NULL;
+    lib->top = NULL;
+    lib->filter = NULL;
+    lib->lock = NULL;
+    lib->journal = NULL;
+    lib->journal_lsn = 0;
+    lib->list_edits = 0;
+    lib->undo = NULL;
     return lib;
 }
 
-static void freeBookList(Book *head){
-    while (head){
-        Book *temp = head;
-        head = head->next;
-        free(temp);
-    }
-}
+static void poolReset(BookPool *pool);
+static void arenaReset(StringArena *arena);
+static void ratingInsert(RatingIndex *ratings, Book *book);
+static void ratingRemove(RatingIndex *ratings, const Book *book);
 
 void destroyLibrary(Library *lib){
     if (!lib) return;
-    freeBookList(lib->main_list);
-    freeBookList(lib->high_rated);
-    freeBookList(lib->low_rated);
+    closeJournal(lib);
+    clearUndoLog(lib);
+    poolReset(&lib->pool);  // every node lives in the pool, so no list walks
+    arenaReset(&lib->strings);
+    destroySearchIndex(lib->search);
+    destroyTopCache(lib->top);
+    destroyIsbnFilter(lib->filter);
+    destroyLibraryLock(lib->lock);
+    free(lib->index.slots);
     free(lib);
 }
 
-// ============= HELPER FUNCTIONS =============
+// ============= NODE POOL =============
+
+#define POOL_CHUNK_BOOKS 512
+
+typedef struct BookChunk{
+    struct BookChunk *next;
+    Book books[POOL_CHUNK_BOOKS];
+}BookChunk;
 
-Book* getCurrentList(Library *lib, char choice){
-    if (choice == 'a') return lib->high_rated;
-    if (choice == 'b') return lib->low_rated;
-    return lib->main_list;
+// Releases every chunk in bulk; all nodes handed out become invalid
+static void poolReset(BookPool *pool){
+    while (pool->chunks){
+        BookChunk *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    pool->used = 0;
+    pool->free_list = NULL;
+    pool->live = 0;
 }
 
-Book** getCurrentListPtr(Library *lib, char choice){
-    if (choice == 'a') return &lib->high_rated;
-    if (choice == 'b') return &lib->low_rated;
-    return &lib->main_list;
+static Book* poolAlloc(BookPool *pool){
+    Book *book = pool->free_list;
+    if (book){
+        pool->free_list = book->next;
+    }
+    else{
+        if (!pool->chunks || pool->used == POOL_CHUNK_BOOKS){
+            BookChunk *chunk = malloc(sizeof(BookChunk));
+            if (!chunk) return NULL;
+            STATS_BYTES(sizeof(BookChunk));
+            chunk->next = pool->chunks;
+            pool->chunks = chunk;
+            pool->used = 0;
+        }
+        book = &pool->chunks->books[pool->used++];
+    }
+    pool->live++;
+    return book;
 }
 
-// ============= BOOK OPERATIONS =============
+// Splices a run of count nodes onto the free list; an empty pool gives its chunks back
+static void poolFreeRun(BookPool *pool, Book *head, Book *tail, size_t count){
+    if (!head) return;
+    tail->next = pool->free_list;
+    pool->free_list = head;
+    pool->live -= count;
+    if (!pool->live) poolReset(pool);
+}
 
-static int isbnExists(Book *head, long isbn){
-    while (head){
-        if (head->isbn == isbn) return 1;
-        head = head->next;
+static void poolFree(BookPool *pool, Book *book){
+    poolFreeRun(pool, book, book, 1);
+}
+
+// ============= STRING ARENA =============
+
+#define ARENA_MIN_CAPACITY  4096
+#define INTERN_MIN_CAPACITY 64
+#define ARENA_NONE          UINT32_MAX  // failed append; offsets are 32-bit
+
+static void arenaReset(StringArena *arena){
+    free(arena->data);
+    free(arena->authors);
+    *arena = (StringArena){0};
+}
+
+static uint32_t hashString(const char *str, size_t len){
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < len; i++){
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
     }
-    return 0;
+    return hash;
 }
 
-Book* addBook(Library *lib, const char *title, const char *author, long isbn, float rating){
-    if (!lib || lib->is_split){
-        printError("Cannot add books while library is split!");
-        return NULL;
+static int arenaReserve(StringArena *arena, size_t extra){
+    if (arena->used + extra <= arena->capacity) return 1;
+    if (arena->used + extra > UINT32_MAX) return 0;
+
+    size_t capacity = arena->capacity ? arena->capacity : ARENA_MIN_CAPACITY;
+    while (capacity < arena->used + extra) capacity *= 2;
+    if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+
+    char *data = realloc(arena->data, capacity);
+    if (!data) return 0;
+    STATS_BYTES(capacity - arena->capacity);
+    if (!arena->data){
+        data[0] = '\0';  // offset 0 is reserved so it can mark empty intern slots
+        arena->used = 1;
     }
+    arena->data = data;
+    arena->capacity = capacity;
+    return 1;
+}
 
-    if (isbnExists(lib->main_list, isbn)){
-        printf(BOLD RED"Book with ISBN %ld already exists!\n"RESET, isbn);
-        return NULL;
+// str must not point into the arena itself, since growing may move it
+static uint32_t arenaAppend(StringArena *arena, const char *str, size_t len){
+    if (!arenaReserve(arena, len + 1)) return ARENA_NONE;
+    uint32_t offset = (uint32_t)arena->used;
+    memcpy(arena->data + offset, str, len);
+    arena->data[offset + len] = '\0';
+    arena->used += len + 1;
+    return offset;
+}
+
+static int internGrow(StringArena *arena){
+    size_t capacity = arena->author_capacity ? arena->author_capacity * 2 : INTERN_MIN_CAPACITY;
+    InternSlot *slots = calloc(capacity, sizeof(InternSlot));
+    if (!slots) return 0;
+    STATS_BYTES(capacity * sizeof(InternSlot));
+
+    size_t mask = capacity - 1;
+    for (size_t j = 0; j < arena->author_capacity; j++){
+        if (!arena->authors[j].offset) continue;
+        size_t i = arena->authors[j].hash & mask;
+        while (slots[i].offset) i = (i + 1) & mask;
+        slots[i] = arena->authors[j];
     }
+    free(arena->authors);
+    arena->authors = slots;
+    arena->author_capacity = capacity;
+    return 1;
+}
 
-    Book *newBook = malloc(sizeof(Book));
-    if (!newBook){
-        printError("Memory allocation failed!");
-        return NULL;
+// Finds the intern slot for a string, or the empty slot where it belongs
+static InternSlot* internSlot(StringArena *arena, const char *str, size_t len, uint32_t hash){
+    size_t mask = arena->author_capacity - 1;
+    size_t i = hash & mask;
+    while (arena->authors[i].offset){
+        const char *other = arena->data + arena->authors[i].offset;
+        if (arena->authors[i].hash == hash && memcmp(other, str, len) == 0 && other[len] == '\0'){
+            break;
+        }
+        i = (i + 1) & mask;
     }
+    return &arena->authors[i];
+}
 
-    strncpy(newBook->title, title, MAXNAME - 1);
-    newBook->title[MAXNAME - 1] = '\0';
-    strncpy(newBook->author, author, MAXNAME - 1);
-    newBook->author[MAXNAME - 1] = '\0';
-    newBook->isbn = isbn;
-    newBook->rating = rating;
-    newBook->next = NULL;
+// Offset of the shared copy of an author name, appending it on first use
+static uint32_t internAuthor(StringArena *arena, const char *str, size_t len){
+    if ((arena->author_count + 1) * 10 > arena->author_capacity * 7 && !internGrow(arena)) return ARENA_NONE;
+
+    uint32_t hash = hashString(str, len);
+    InternSlot *slot = internSlot(arena, str, len, hash);
+    if (slot->offset) return slot->offset;
+
+    uint32_t offset = arenaAppend(arena, str, len);
+    if (offset == ARENA_NONE) return ARENA_NONE;
+    slot->offset = offset;
+    slot->hash = hash;
+    arena->author_count++;
+    return offset;
+}
 
-    if (!lib->main_list){
-        lib->main_list = newBook;
+// A loaded blob counts as dead until books claim its strings
+static void arenaClaim(StringArena *arena, size_t bytes){
+    arena->dead -= bytes < arena->dead ? bytes : arena->dead;
+}
+
+// Registers an author already stored at offset; returns the canonical offset
+static uint32_t internExisting(StringArena *arena, uint32_t offset){
+    if ((arena->author_count + 1) * 10 > arena->author_capacity * 7 && !internGrow(arena)) return ARENA_NONE;
+
+    const char *str = arena->data + offset;
+    size_t len = strlen(str);
+    uint32_t hash = hashString(str, len);
+    InternSlot *slot = internSlot(arena, str, len, hash);
+    if (slot->offset) return slot->offset;
+    slot->offset = offset;
+    slot->hash = hash;
+    arena->author_count++;
+    arenaClaim(arena, len + 1);
+    return offset;
+}
+
+const char* bookTitle(const Library *lib, const Book *book){
+    return lib->strings.data + book->title;
+}
+
+const char* bookAuthor(const Library *lib, const Book *book){
+    return lib->strings.data + book->author;
+}
+
+// Per-book bookkeeping before a node goes back to the pool. Titles are owned
+// by one book, so deleting it turns them into garbage.
+static void forgetBook(Library *lib, const Book *book){
+    lib->list_edits++;
+    lib->strings.dead += strlen(bookTitle(lib, book)) + 1;
+    if (lib->ratings.built) ratingRemove(&lib->ratings, book);
+    if (lib->search && !searchIndexRemove(lib->search, book)){
+        // Deleted books' postings stay until a rebuild; drop them now rather
+        // than let churn without searches grow the index
+        destroySearchIndex(lib->search);
+        lib->search = NULL;
     }
-    else{
-        Book *temp = lib->main_list;
-        while (temp->next) temp = temp->next;
-        temp->next = newBook;
+    if (lib->top) topCacheRemove(lib->top, book);
+    if (lib->filter) isbnFilterRemove(lib->filter, &lib->index);
+}
+
+// ============= ISBN INDEX =============
+
+#define INDEX_MIN_CAPACITY 64
+
+static size_t hashIsbn(long isbn){
+    unsigned long long x = (unsigned long long)isbn;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static Book* indexFind(const IsbnIndex *idx, long isbn){
+    if (!idx->capacity) return NULL;
+    size_t mask = idx->capacity - 1;
+    size_t i = hashIsbn(isbn) & mask;
+    while (idx->slots[i].book){
+        if (idx->slots[i].isbn == isbn) return idx->slots[i].book;
+        i = (i + 1) & mask;
     }
+    return NULL;
+}
 
-    lib->last_added = newBook;  // Track the most recently added book
-    return newBook;
+static int indexResize(IsbnIndex *idx, size_t capacity){
+    IndexSlot *slots = calloc(capacity, sizeof(IndexSlot));
+    if (!slots) return 0;
+    STATS_BYTES(capacity * sizeof(IndexSlot));
+
+    size_t mask = capacity - 1;
+    for (size_t j = 0; j < idx->capacity; j++){
+        if (!idx->slots[j].book) continue;
+        size_t i = hashIsbn(idx->slots[j].isbn) & mask;
+        while (slots[i].book) i = (i + 1) & mask;
+        slots[i] = idx->slots[j];
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->capacity = capacity;
+    return 1;
 }
 
-void displayBooks(Book *head, const char *list_name){
-    if (!head){
-        printf(BOLD RED"No books in %s.\n"RESET, list_name);
-        return;
+// Inserts book, or repoints the slot if its ISBN is already indexed
+static int indexInsert(IsbnIndex *idx, Book *book){
+    // Keep the load factor under 70% so probe runs stay short
+    if ((idx->count + 1) * 10 > idx->capacity * 7 &&
+        !indexResize(idx, idx->capacity ? idx->capacity * 2 : INDEX_MIN_CAPACITY)) return 0;
+
+    size_t mask = idx->capacity - 1;
+    size_t i = hashIsbn(book->isbn) & mask;
+    while (idx->slots[i].book){
+        if (idx->slots[i].isbn == book->isbn){
+            idx->slots[i].book = book;
+            return 1;
+        }
+        i = (i + 1) & mask;
     }
+    idx->slots[i].isbn = book->isbn;
+    idx->slots[i].book = book;
+    idx->count++;
+    return 1;
+}
 
-    printf(BOLD BLUE"\n=== %s ===\n"RESET, list_name);
-    int num = 1;
-    while (head){
-        printf(BOLD"%d. Title: %s\n"RESET, num, head->title);
-        printf("   Author: %s | ISBN: %ld | Rating: %.1f★\n", 
-               head->author, head->isbn, head->rating);
-        head = head->next;
-        num++;
+// Backward-shift deletion: no tombstones, so lookups never degrade
+static void indexRemove(IsbnIndex *idx, long isbn){
+    if (!idx->capacity) return;
+    size_t mask = idx->capacity - 1;
+    size_t i = hashIsbn(isbn) & mask;
+    while (idx->slots[i].book && idx->slots[i].isbn != isbn){
+        i = (i + 1) & mask;
     }
+    if (!idx->slots[i].book) return;
+
+    size_t j = i;
+    while (1){
+        j = (j + 1) & mask;
+        if (!idx->slots[j].book) break;
+        size_t home = hashIsbn(idx->slots[j].isbn) & mask;
+        // Move the entry back unless its home lies cyclically in (i, j]
+        int stays = (i < j) ? (home > i && home <= j) : (home > i || home <= j);
+        if (!stays){
+            idx->slots[i] = idx->slots[j];
+            i = j;
+        }
+    }
+    idx->slots[i].book = NULL;
+    idx->count--;
 }
 
-Book* findBook(Book *head, long isbn){
-    while (head){
-        if (head->isbn == isbn){
-            printSuccess("Book found!");
-            printf("Title: %s\nAuthor: %s\nISBN: %ld\nRating: %.1f★\n",
-                   head->title, head->author, head->isbn, head->rating);
-            return head;
+// Grows the table up front so inserting count entries never rehashes
+static int indexReserve(IsbnIndex *idx, size_t count){
+    size_t capacity = idx->capacity ? idx->capacity : INDEX_MIN_CAPACITY;
+    while (count * 10 > capacity * 7) capacity *= 2;
+    return capacity == idx->capacity || indexResize(idx, capacity);
+}
+
+static void indexClear(IsbnIndex *idx){
+    if (idx->capacity) memset(idx->slots, 0, idx->capacity * sizeof(IndexSlot));
+    idx->count = 0;
+}
+
+// Every lookup by ISBN comes through here, so the filter, when there is one,
+// can turn away a definite miss before the table is probed
+static Book* findIsbn(Library *lib, long isbn){
+    if (lib->filter && !isbnFilterMayContain(lib->filter, isbn)) return NULL;
+    Book *book = indexFind(&lib->index, isbn);
+    if (!book && lib->filter) isbnFilterMissed(lib->filter);
+    return book;
+}
+
+// ============= RATING INDEX =============
+
+// Heap priorities come from the ISBN hash, so the tree shape is a pure function
+// of its contents and no per-node field is needed
+static size_t ratingPriority(const Book *book){
+    return hashIsbn(book->isbn);
+}
+
+// Index order: rating, then ISBN, so every key is unique
+static int ratingBefore(const Book *a, const Book *b){
+    return a->rating < b->rating || (a->rating == b->rating && a->isbn < b->isbn);
+}
+
+// Splits tree into the nodes ordered before key and the rest
+static void ratingSplit(Book *tree, const Book *key, Book **before, Book **after){
+    while (tree){
+        if (ratingBefore(tree, key)){
+            *before = tree;
+            before = &tree->right;
+            tree = tree->right;
+        }
+        else{
+            *after = tree;
+            after = &tree->left;
+            tree = tree->left;
         }
-        head = head->next;
     }
-    printf(BOLD RED"Book with ISBN %ld not found.\n"RESET, isbn);
-    return NULL;
+    *before = *after = NULL;
 }
 
-void deleteLastAddedBook(Library *lib){
-    if (!lib){
-        printError("Library does not exist.");
-        return;
+// Joins two trees where every node of first orders before every node of second
+static Book* ratingJoin(Book *first, Book *second){
+    Book *root = NULL, **link = &root;
+    while (first && second){
+        if (ratingPriority(first) > ratingPriority(second)){
+            *link = first;
+            link = &first->right;
+            first = first->right;
+        }
+        else{
+            *link = second;
+            link = &second->left;
+            second = second->left;
+        }
     }
+    *link = first ? first : second;
+    return root;
+}
 
-    // Check which list we're working with
-    Book **current_list;
-    if (lib->is_split){
-        printError("Cannot delete last added book from split lists. Use delete by ISBN instead.");
-        return;
+static void ratingInsert(RatingIndex *ratings, Book *book){
+    Book **link = &ratings->root;
+    size_t priority = ratingPriority(book);
+    while (*link && ratingPriority(*link) > priority){
+        link = ratingBefore(book, *link) ? &(*link)->left : &(*link)->right;
+    }
+    ratingSplit(*link, book, &book->left, &book->right);
+    *link = book;
+}
+
+static void ratingRemove(RatingIndex *ratings, const Book *book){
+    Book **link = &ratings->root;
+    while (*link != book) link = ratingBefore(book, *link) ? &(*link)->left : &(*link)->right;
+    *link = ratingJoin(book->left, book->right);
+}
+
+static int compareRatingOrder(const void *a, const void *b){
+    const Book *x = *(Book * const *)a, *y = *(Book * const *)b;
+    return ratingBefore(x, y) ? -1 : ratingBefore(y, x);
+}
+
+// Sorts every book once, then builds the treap along its right spine in O(n)
+static int ratingBuild(Library *lib){
+    size_t total = lib->pool.live, n = 0;
+    Book **books = malloc((total ? total : 1) * sizeof(Book *));
+    Book **spine = malloc((total ? total : 1) * sizeof(Book *));
+    if (!books || !spine){
+        free(books);
+        free(spine);
+        return 0;
+    }
+    STATS_BYTES(2 * (total ? total : 1) * sizeof(Book *));
+
+    for (Book *temp = lib->main_list.head; temp; temp = temp->next) books[n++] = temp;
+    for (int i = 0; i < lib->bucket_count; i++){
+        for (Book *temp = lib->buckets[i].head; temp; temp = temp->next) books[n++] = temp;
+    }
+    qsort(books, n, sizeof(Book *), compareRatingOrder);
+
+    size_t top = 0;
+    for (size_t i = 0; i < n; i++){
+        Book *book = books[i], *last = NULL;
+        while (top && ratingPriority(spine[top - 1]) < ratingPriority(book)) last = spine[--top];
+        book->left = last;
+        book->right = NULL;
+        if (top) spine[top - 1]->right = book;
+        spine[top++] = book;
+    }
+    lib->ratings.root = top ? spine[0] : NULL;
+    lib->ratings.built = 1;
+    free(books);
+    free(spine);
+    return 1;
+}
+
+typedef struct{
+    Book **books;
+    size_t count;
+    size_t capacity;
+}BookArray;
+
+static int pushBook(BookArray *array, Book *book){
+    if (array->count == array->capacity){
+        size_t capacity = array->capacity ? array->capacity * 2 : 64;
+        Book **books = realloc(array->books, capacity * sizeof(Book *));
+        if (!books) return 0;
+        STATS_BYTES((capacity - array->capacity) * sizeof(Book *));
+        array->books = books;
+        array->capacity = capacity;
+    }
+    array->books[array->count++] = book;
+    return 1;
+}
+
+// In-order walk that only enters subtrees overlapping [lo, hi)
+static int collectRange(Book *node, float lo, float hi, BookArray *out){
+    while (node){
+        if (node->rating < lo){
+            node = node->right;
+            continue;
+        }
+        if (node->rating >= hi){
+            node = node->left;
+            continue;
+        }
+        if (!collectRange(node->left, lo, hi, out) || !pushBook(out, node)) return 0;
+        node = node->right;
+    }
+    return 1;
+}
+
+int booksInRatingRange(Library *lib, float lo, float hi, Book ***results, size_t *count){
+    STATS_SCOPE(STAT_RANGE);
+    *results = NULL;
+    *count = 0;
+    if (!lib->ratings.built && !ratingBuild(lib)) return 0;
+
+    BookArray out = {0};
+    if (!collectRange(lib->ratings.root, lo, hi, &out)){
+        free(out.books);
+        return 0;
+    }
+    *results = out.books;
+    *count = out.count;
+    return 1;
+}
+
+// ============= HELPER FUNCTIONS =============
+
+int isListChoice(const Library *lib, char choice){
+    return choice == 'm' || (choice >= 'a' && choice < 'a' + lib->bucket_count);
+}
+
+BookList* getCurrentList(Library *lib, char choice){
+    if (choice >= 'a' && choice < 'a' + lib->bucket_count) return &lib->buckets[choice - 'a'];
+    return &lib->main_list;
+}
+
+static int bucketOf(const Library *lib, float rating){
+    int i = 0;
+    while (i < lib->bucket_count - 1 && rating < lib->cuts[i]) i++;
+    return i;
+}
+
+// Buckets are partitioned purely by rating, so membership needs no lookup
+char listForRating(const Library *lib, float rating){
+    if (!lib->is_split) return 'm';
+    return (char)('a' + bucketOf(lib, rating));
+}
+
+char listChoiceOf(const Library *lib, const Book *book){
+    return listForRating(lib, book->rating);
+}
+
+static RatingSum ratingUnits(float rating){
+    return (RatingSum)(rating * RATING_SUM_UNIT);
+}
+
+static void appendBook(BookList *list, Book *book){
+    book->next = NULL;
+    book->prev = list->tail;
+    if (list->tail) list->tail->next = book;
+    else list->head = book;
+    list->tail = book;
+    list->count++;
+    list->rating_sum += ratingUnits(book->rating);
+}
+
+static void unlinkBook(BookList *list, Book *book){
+    if (book->prev) book->prev->next = book->next;
+    else list->head = book->next;
+    if (book->next) book->next->prev = book->prev;
+    else list->tail = book->prev;
+    list->count--;
+    list->rating_sum -= ratingUnits(book->rating);
+}
+
+// Appends src to dst and leaves src empty
+static void concatLists(BookList *dst, BookList *src){
+    if (!src->head) return;
+    if (dst->tail){
+        dst->tail->next = src->head;
+        src->head->prev = dst->tail;
     }
     else{
-        current_list = &lib->main_list;
+        dst->head = src->head;
     }
+    dst->tail = src->tail;
+    dst->count += src->count;
+    dst->rating_sum += src->rating_sum;
+    *src = (BookList){0};
+}
+
+// Takes a book out of list and every index; the caller decides what happens to the node
+static void dropBook(Library *lib, BookList *list, Book *book){
+    unlinkBook(list, book);
+    indexRemove(&lib->index, book->isbn);
+    forgetBook(lib, book);
+}
 
-    if (!*current_list){
-        printError("List is empty, nothing to delete.");
-        return;
+// Adds a linked book to the optional indexes that exist
+static void indexBook(Library *lib, Book *book){
+    if (lib->ratings.built) ratingInsert(&lib->ratings, book);
+    if (lib->search && !searchIndexAdd(lib->search, lib, book)){
+        // Out of memory: drop the index and rebuild it on the next search
+        destroySearchIndex(lib->search);
+        lib->search = NULL;
     }
+    if (lib->top) topCacheAdd(lib->top, book);
+    if (lib->filter) isbnFilterAdd(lib->filter, &lib->index, book->isbn);
+}
+
+// ============= UNDO LOG =============
+
+#define UNDO_MAX_HELD (1 << 22)  // node pointers kept for list-wide steps (32 MB)
+
+typedef enum{
+    UNDO_ADD,
+    UNDO_DELETE,
+    UNDO_SORT,
+    UNDO_SPLIT,
+    UNDO_MERGE,
+    UNDO_BUCKETS
+}UndoKind;
+
+static const char *const undoNames[] = {"add", "delete", "sort", "split", "merge", "buckets"};
+
+// The lists as they were before a list-wide step. Lists the step reordered
+// keep their nodes in order; the rest only need cutting apart again.
+typedef struct{
+    BookList lists[1 + MAX_BUCKETS];  // main_list, then the buckets
+    float cuts[MAX_BUCKETS - 1];
+    int bucket_count;
+    int is_split;
+    uint32_t reordered;  // bit i set when lists[i] is saved in order
+    size_t count;
+    Book *order[];
+}ListLayout;
+
+typedef struct{
+    UndoKind kind;
+    Book *book;          // added node, or deleted node the log still owns
+    ListLayout *layout;  // list-wide steps
+    Book *last_added;    // lib->last_added before the step
+}UndoStep;
+
+// Ring of the newest steps. Steps are undone newest first, so whatever a step
+// left behind is exactly what its undo finds: a deleted node's own prev/next
+// still name its neighbours, and a merged bucket's nodes are still linked.
+struct UndoLog{
+    UndoStep steps[UNDO_MAX_STEPS];
+    size_t first;  // oldest step
+    size_t count;
+    size_t held;   // books saved in layouts
+};
+
+static BookList* slotList(Library *lib, int slot){
+    return slot ? &lib->buckets[slot - 1] : &lib->main_list;
+}
 
-    if (!lib->last_added){
-        printError("No record of last added book. Use delete by ISBN instead.");
-        return;
+static uint32_t slotBit(const Library *lib, const BookList *list){
+    return 1u << (list == &lib->main_list ? 0 : list - lib->buckets + 1);
+}
+
+// Saves every list header and the split state, with room for the node order
+// of the lists in mask; NULL when memory runs out. The step fills order in
+// the pass it already makes over those lists, so saving costs no extra walk.
+static ListLayout* captureLayout(Library *lib, uint32_t mask){
+    size_t count = 0;
+    for (int i = 0; i <= MAX_BUCKETS; i++){
+        if (mask & (1u << i)) count += slotList(lib, i)->count;
     }
+    ListLayout *layout = malloc(sizeof(ListLayout) + count * sizeof(Book *));
+    if (!layout) return NULL;
+    STATS_BYTES(sizeof(ListLayout) + count * sizeof(Book *));
 
-    // Check if last_added is in the current list
-    Book *temp = *current_list;
-    Book *prev = NULL;
-    int found = 0;
+    layout->lists[0] = lib->main_list;
+    memcpy(layout->lists + 1, lib->buckets, sizeof(lib->buckets));
+    memcpy(layout->cuts, lib->cuts, sizeof(lib->cuts));
+    layout->bucket_count = lib->bucket_count;
+    layout->is_split = lib->is_split;
+    layout->reordered = mask;
+    layout->count = count;
+    return layout;
+}
+
+static void restoreLayout(Library *lib, const ListLayout *layout){
+    lib->main_list = layout->lists[0];
+    memcpy(lib->buckets, layout->lists + 1, sizeof(lib->buckets));
+    memcpy(lib->cuts, layout->cuts, sizeof(lib->cuts));
+    lib->bucket_count = layout->bucket_count;
+    lib->is_split = layout->is_split;
+
+    Book *const *order = layout->order;
+    for (int i = 0; i <= MAX_BUCKETS; i++){
+        BookList *list = slotList(lib, i);
+        if (layout->reordered & (1u << i)){
+            Book *prev = NULL;
+            for (size_t n = 0; n < list->count; n++){
+                Book *book = *order++;
+                book->prev = prev;
+                if (prev) prev->next = book;
+                prev = book;
+            }
+            if (prev) prev->next = NULL;
+        }
+        else if (list->head){
+            list->head->prev = NULL;
+            list->tail->next = NULL;
+        }
+    }
+    lib->list_edits++;
+}
+
+// Puts a deleted node back between the neighbours it had; 0 only when memory runs out
+static int relinkBook(Library *lib, Book *book){
+    if (!indexInsert(&lib->index, book)) return 0;
+    BookList *list = getCurrentList(lib, listChoiceOf(lib, book));
+    if (book->prev) book->prev->next = book;
+    else list->head = book;
+    if (book->next) book->next->prev = book;
+    else list->tail = book;
+    list->count++;
+    list->rating_sum += ratingUnits(book->rating);
+    lib->strings.dead -= strlen(bookTitle(lib, book)) + 1;
+    indexBook(lib, book);
+    lib->list_edits++;
+    return 1;
+}
+
+// Gives back what a step owns once it can no longer be undone
+static void releaseStep(Library *lib, UndoStep *step){
+    if (step->kind == UNDO_DELETE) poolFree(&lib->pool, step->book);
+    free(step->layout);
+}
+
+static void dropOldestStep(Library *lib){
+    struct UndoLog *log = lib->undo;
+    UndoStep *step = &log->steps[log->first];
+    if (step->layout) log->held -= step->layout->count;
+    releaseStep(lib, step);
+    log->first = (log->first + 1) % UNDO_MAX_STEPS;
+    log->count--;
+}
+
+// Older steps make room when the ring is full or the layouts hold too many
+// books; the newest step is always kept
+static void recordStep(Library *lib, UndoKind kind, Book *book, ListLayout *layout, Book *last_added){
+    UndoStep step = {kind, book, layout, last_added};
+    if (!lib->undo){
+        lib->undo = calloc(1, sizeof(struct UndoLog));
+        if (!lib->undo){
+            releaseStep(lib, &step);
+            return;
+        }
+        STATS_BYTES(sizeof(struct UndoLog));
+    }
 
-    while (temp){
-        if (temp == lib->last_added){
-            found = 1;
+    struct UndoLog *log = lib->undo;
+    size_t held = layout ? layout->count : 0;
+    if (log->count == UNDO_MAX_STEPS) dropOldestStep(lib);
+    while (log->count && log->held + held > UNDO_MAX_HELD) dropOldestStep(lib);
+    log->steps[(log->first + log->count++) % UNDO_MAX_STEPS] = step;
+    log->held += held;
+}
+
+// A list-wide step whose layout could not be saved cannot be undone, and
+// neither can anything before it
+static void recordLayout(Library *lib, UndoKind kind, ListLayout *layout){
+    if (layout) recordStep(lib, kind, NULL, layout, lib->last_added);
+    else clearUndoLog(lib);
+}
+
+BookStatus undoLastChange(Library *lib){
+    STATS_SCOPE(STAT_UNDO);
+    if (!lib) return BOOK_NO_LIBRARY;
+    struct UndoLog *log = lib->undo;
+    if (!log || !log->count) return BOOK_NOTHING_TO_UNDO;
+
+    UndoStep *step = &log->steps[(log->first + log->count - 1) % UNDO_MAX_STEPS];
+    switch (step->kind){
+        case UNDO_ADD:
+            dropBook(lib, getCurrentList(lib, listChoiceOf(lib, step->book)), step->book);
+            poolFree(&lib->pool, step->book);
+            break;
+        case UNDO_DELETE:
+            if (!relinkBook(lib, step->book)) return BOOK_NO_MEMORY;
             break;
+        default:
+            restoreLayout(lib, step->layout);
+            log->held -= step->layout->count;
+            free(step->layout);
+    }
+    lib->last_added = step->last_added;
+    log->count--;
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_UNDO, 'm');
+    return BOOK_OK;
+}
+
+const char* nextUndoName(const Library *lib){
+    const struct UndoLog *log = lib->undo;
+    if (!log || !log->count) return NULL;
+    return undoNames[log->steps[(log->first + log->count - 1) % UNDO_MAX_STEPS].kind];
+}
+
+size_t undoSteps(const Library *lib){
+    return lib->undo ? lib->undo->count : 0;
+}
+
+void clearUndoLog(Library *lib){
+    if (!lib->undo) return;
+    while (lib->undo->count) dropOldestStep(lib);
+    free(lib->undo);
+    lib->undo = NULL;
+}
+
+// ============= STRING COMPACTION =============
+
+#define STRINGS_COMPACT_MIN (64 * 1024)  // dead bytes before an automatic rewrite pays off
+
+// Copies a book's strings into fresh, which has room for all of them
+static void moveStrings(const StringArena *old, StringArena *fresh, Book *book){
+    const char *author = old->data + book->author, *title = old->data + book->title;
+    book->author = internAuthor(fresh, author, strlen(author));
+    book->title = arenaAppend(fresh, title, strlen(title));
+}
+
+size_t compactStrings(Library *lib, int force){
+    StringArena *old = &lib->strings;
+    if (!old->dead || (!force && (old->dead < STRINGS_COMPACT_MIN || old->dead * 2 < old->used))) return 0;
+
+    // Room for everything the old arena holds, so no append below can fail
+    StringArena fresh = {0};
+    size_t slots = INTERN_MIN_CAPACITY;
+    while ((old->author_count + 1) * 10 > slots * 7) slots *= 2;
+    fresh.authors = calloc(slots, sizeof(InternSlot));
+    if (!fresh.authors || !arenaReserve(&fresh, old->used - 1)){
+        arenaReset(&fresh);
+        return 0;
+    }
+    STATS_BYTES(slots * sizeof(InternSlot));
+    fresh.author_capacity = slots;
+
+    // List order, so walks read titles front to back too. Deleted books held
+    // for undo keep their strings, still counted as dead.
+    for (int i = 0; i <= MAX_BUCKETS; i++){
+        for (Book *book = slotList(lib, i)->head; book; book = book->next) moveStrings(old, &fresh, book);
+    }
+    const struct UndoLog *log = lib->undo;
+    for (size_t n = 0; log && n < log->count; n++){
+        const UndoStep *step = &log->steps[(log->first + n) % UNDO_MAX_STEPS];
+        if (step->kind != UNDO_DELETE) continue;
+        moveStrings(old, &fresh, step->book);
+        fresh.dead += strlen(fresh.data + step->book->title) + 1;
+    }
+
+    size_t capacity = ARENA_MIN_CAPACITY;
+    while (capacity < fresh.used) capacity *= 2;
+    if (capacity < fresh.capacity){
+        char *data = realloc(fresh.data, capacity);
+        if (data){
+            fresh.data = data;
+            fresh.capacity = capacity;
         }
-        prev = temp;
-        temp = temp->next;
     }
+    size_t before = old->capacity + old->author_capacity * sizeof(InternSlot);
+    size_t after = fresh.capacity + fresh.author_capacity * sizeof(InternSlot);
+    arenaReset(old);
+    *old = fresh;
+    return before > after ? before - after : 0;
+}
 
-    if (!found){
-        printError("Last added book not found in current list.");
-        lib->last_added = NULL;
-        return;
+// ============= BOOK OPERATIONS =============
+
+// Links an already-filled node at the tail of list; 0 only when memory runs out
+static int linkNewBook(Library *lib, BookList *list, Book *newBook){
+    if (!indexInsert(&lib->index, newBook)){
+        poolFree(&lib->pool, newBook);
+        return 0;
+    }
+    appendBook(list, newBook);
+    indexBook(lib, newBook);
+    recordStep(lib, UNDO_ADD, newBook, NULL, lib->last_added);
+    if (lib->journal){
+        journalLogAdd(lib->journal, listChoiceOf(lib, newBook), newBook->isbn, newBook->rating,
+                      bookTitle(lib, newBook), bookAuthor(lib, newBook));
     }
+    return 1;
+}
+
+// Links a new node at the tail of list; NULL only when memory runs out
+static Book* insertBook(Library *lib, BookList *list, const char *title, const char *author, long isbn, float rating){
+    compactStrings(lib, 0);  // deleted titles would otherwise pile up for the life of the library
+    // Author first: a failed title append can then be rolled back by truncation
+    uint32_t author_off = internAuthor(&lib->strings, author, strlen(author));
+    if (author_off == ARENA_NONE) return NULL;
+    uint32_t title_off = arenaAppend(&lib->strings, title, strlen(title));
+    if (title_off == ARENA_NONE) return NULL;
 
-    // Delete the book
-    if (prev == NULL){
-        // Deleting the head
-        *current_list = lib->last_added->next;
+    Book *newBook = poolAlloc(&lib->pool);
+    if (!newBook){
+        lib->strings.used = title_off;
+        return NULL;
     }
-    else{
-        prev->next = lib->last_added->next;
+    newBook->isbn = isbn;
+    newBook->rating = rating;
+    newBook->title = title_off;
+    newBook->author = author_off;
+
+    if (!linkNewBook(lib, list, newBook)){
+        lib->strings.used = title_off;
+        return NULL;
     }
+    return newBook;
+}
+
+// While split, a new book goes straight into its rating bucket
+BookStatus addBook(Library *lib, const char *title, const char *author, long isbn, float rating){
+    STATS_SCOPE(STAT_ADD);
+    if (!lib) return BOOK_NO_LIBRARY;
+    if (findIsbn(lib, isbn)) return BOOK_DUPLICATE;
+
+    Book *newBook = insertBook(lib, getCurrentList(lib, listForRating(lib, rating)), title, author, isbn, rating);
+    if (!newBook) return BOOK_NO_MEMORY;
 
-    printf(BOLD GREEN"Deleted last added book: '%s' by %s\n"RESET, 
-           lib->last_added->title, lib->last_added->author);
-    
-    free(lib->last_added);
+    lib->last_added = newBook;  // Track the most recently added book
+    return BOOK_OK;
+}
+
+int reserveBooks(Library *lib, size_t count){
+    return indexReserve(&lib->index, lib->index.count + count);
+}
+
+Book* loadBook(Library *lib, char choice, const char *title, const char *author, long isbn, float rating){
+    STATS_SCOPE(STAT_LOAD);
+    if (findIsbn(lib, isbn)) return NULL;
+    return insertBook(lib, getCurrentList(lib, choice), title, author, isbn, rating);
+}
+
+int loadStrings(Library *lib, const char *data, size_t size){
+    // Only a fresh library can adopt a blob; it must end in a terminator so
+    // every offset inside it names a complete string
+    if (lib->strings.used > 1 || !size || data[size - 1] != '\0' || data[0] != '\0') return 0;
+    arenaReset(&lib->strings);
+    if (!arenaReserve(&lib->strings, size)) return 0;
+    memcpy(lib->strings.data, data, size);
+    lib->strings.used = size;
+    lib->strings.dead = size - 1;
+    return 1;
+}
+
+Book* loadBookByOffset(Library *lib, char choice, long isbn, float rating, uint32_t title, uint32_t author){
+    STATS_SCOPE(STAT_LOAD);
+    if (title >= lib->strings.used || !author || author >= lib->strings.used) return NULL;
+    if (findIsbn(lib, isbn)) return NULL;
+
+    uint32_t author_off = internExisting(&lib->strings, author);
+    if (author_off == ARENA_NONE) return NULL;
+
+    Book *newBook = poolAlloc(&lib->pool);
+    if (!newBook) return NULL;
+    newBook->isbn = isbn;
+    newBook->rating = rating;
+    newBook->title = title;
+    newBook->author = author_off;
+    if (!linkNewBook(lib, getCurrentList(lib, choice), newBook)) return NULL;
+    arenaClaim(&lib->strings, strlen(bookTitle(lib, newBook)) + 1);
+    return newBook;
+}
+
+Book* lookupBook(Library *lib, long isbn){
+    STATS_SCOPE(STAT_LOOKUP);
+    return findIsbn(lib, isbn);
+}
+
+Book* findBook(Library *lib, char choice, long isbn){
+    STATS_SCOPE(STAT_FIND);
+    Book *book = findIsbn(lib, isbn);
+    if (book && getCurrentList(lib, listChoiceOf(lib, book)) == getCurrentList(lib, choice)) return book;
+    return NULL;
+}
+
+BookStatus deleteLastAddedBook(Library *lib){
+    STATS_SCOPE(STAT_DELETE_LAST);
+    if (!lib) return BOOK_NO_LIBRARY;
+    if (!lib->last_added) return !lib->is_split && !lib->main_list.head ? BOOK_LIST_EMPTY : BOOK_NO_LAST_ADDED;
+
+    // last_added is cleared whenever its node leaves the library, so it is
+    // always linked here and the back-link unlinks it without a walk. Split
+    // or not, the node's list follows from its rating.
+    Book *book = lib->last_added;
+    dropBook(lib, getCurrentList(lib, listChoiceOf(lib, book)), book);
     lib->last_added = NULL;
+    recordStep(lib, UNDO_DELETE, book, NULL, book);
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_DELETE_LAST, 'm');
+    return BOOK_OK;
 }
 
-void deleteBookByISBN(Book **head, long isbn){
-    if (!*head){
-        printError("List is empty.");
-        return;
-    }
+BookStatus deleteBookByISBN(Library *lib, char choice, long isbn){
+    STATS_SCOPE(STAT_DELETE);
+    BookList *list = getCurrentList(lib, choice);
+    if (!list->head) return BOOK_LIST_EMPTY;
+
+    Book *toDelete = findIsbn(lib, isbn);
+    if (!toDelete || getCurrentList(lib, listChoiceOf(lib, toDelete)) != list) return BOOK_NOT_FOUND;
+
+    if (lib->journal) journalLogDelete(lib->journal, listChoiceOf(lib, toDelete), isbn);
+    Book *last_added = lib->last_added;
+    dropBook(lib, list, toDelete);
+    if (toDelete == lib->last_added) lib->last_added = NULL;
+    recordStep(lib, UNDO_DELETE, toDelete, NULL, last_added);  // the log owns the node now
+    return BOOK_OK;
+}
+
+size_t countBooks(const BookList *list){
+    return list->count;
+}
+
+double averageRating(const BookList *list){
+    return meanRating(list->rating_sum, list->count);
+}
+
+double meanRating(RatingSum sum, size_t count){
+    if (!count) return 0.0;
+    return (double)sum / RATING_SUM_UNIT / (double)count;
+}
+
+// ============= PARALLEL CHUNKS =============
 
-    if ((*head)->isbn == isbn){
-        Book *temp = *head;
-        *head = (*head)->next;
-        free(temp);
-        printf(BOLD GREEN"Book with ISBN %ld deleted.\n"RESET, isbn);
-        return;
+// Bulk operations cut a list into one run per worker thread, work on the runs
+// in parallel, then stitch the results together in run order, so the outcome
+// is the same as one pass over the whole list
+
+#define PARALLEL_MIN_BOOKS 65536  // below this the hand-off costs more than it saves
+
+// Fills chunks with contiguous runs of near-equal length, in list order. The
+// nodes keep their links; only head, tail and count are set. Returns the
+// number of runs, 1 for short lists or a single worker.
+static int chunkList(const BookList *list, BookList *chunks){
+    int parts = workerThreads();
+    if (parts == 1 || list->count < PARALLEL_MIN_BOOKS){
+        chunks[0] = *list;
+        return 1;
     }
 
-    Book *temp = *head;
-    while (temp->next && temp->next->isbn != isbn){
+    Book *temp = list->head;
+    for (int i = 0; i < parts; i++){
+        size_t len = list->count / (size_t)parts + ((size_t)i < list->count % (size_t)parts);
+        chunks[i] = (BookList){0};
+        chunks[i].head = temp;
+        chunks[i].count = len;
+        for (size_t j = 1; j < len; j++) temp = temp->next;
+        chunks[i].tail = temp;
         temp = temp->next;
     }
+    return parts;
+}
 
-    if (!temp->next){
-        printf(BOLD RED"Book with ISBN %ld not found.\n"RESET, isbn);
-        return;
+// Where each chunk's books start in an array holding the whole list in order;
+// all NULL when there is no array
+static void chunkSlots(const BookList *chunks, int parts, Book **order, Book ***slots){
+    for (int i = 0; i < parts; i++){
+        slots[i] = order;
+        if (order) order += chunks[i].count;
     }
+}
+
+// ============= SORTING =============
 
-    Book *toDelete = temp->next;
-    temp->next = temp->next->next;
-    free(toDelete);
-    printf(BOLD GREEN"Book with ISBN %ld deleted.\n"RESET, isbn);
+#define RATING_BUCKETS 51  // 0.0 - 5.0 in steps of 0.1
+#define SORT_BINS 64       // enough runs for any list that fits in memory
+
+// Bucket for a rating entered with one decimal place, -1 if it has more
+static int ratingBucket(float rating){
+    if (!(rating >= 0.0f && rating <= 5.0f)) return -1;
+    int bucket = (int)(rating * 10.0f + 0.5f);
+    return (float)bucket / 10.0f == rating ? bucket : -1;
 }
 
-int countBooks(Book *head){
-    int count = 0;
-    while (head){
-        count++;
-        head = head->next;
+typedef struct{
+    BookList *chunks;
+    BookList *bins;    // RATING_BUCKETS per chunk
+    int *bucketable;   // per chunk
+    Book ***order;     // per chunk: where to save the unsorted order, or NULL
+}CountingSortJob;
+
+static void checkChunkJob(void *arg, size_t task){
+    CountingSortJob *job = arg;
+    Book *temp = job->chunks[task].head;
+    Book **order = job->order[task];
+    job->bucketable[task] = 1;
+    for (size_t i = 0; i < job->chunks[task].count; i++, temp = temp->next){
+        if (order) order[i] = temp;
+        if (ratingBucket(temp->rating) < 0){
+            job->bucketable[task] = 0;
+            if (!order) return;
+        }
     }
-    return count;
 }
 
-float averageRating(Book *head){
-    if (!head) return 0.0f;
-    
-    float sum = 0.0f;
-    int count = 0;
-    while (head){
-        sum += head->rating;
-        count++;
-        head = head->next;
+static void binChunkJob(void *arg, size_t task){
+    CountingSortJob *job = arg;
+    BookList *bins = job->bins + task * RATING_BUCKETS;
+    Book *temp = job->chunks[task].head;
+    for (size_t i = 0; i < job->chunks[task].count; i++){
+        Book *next = temp->next;
+        appendBook(&bins[ratingBucket(temp->rating)], temp);
+        temp = next;
     }
-    return sum / count;
 }
 
-// ============= SORTING =============
+// Stable O(n) counting sort; returns 0 without touching the list if any
+// rating is not bucketable. Each chunk is binned on its own, then the bins
+// are joined rating by rating in chunk order. Either way the order before
+// sorting is saved in order, when given.
+static int countingSortByRating(BookList *list, BookList *chunks, int parts, Book **order){
+    int bucketable[MAX_WORKERS];
+    Book **slots[MAX_WORKERS];
+    chunkSlots(chunks, parts, order, slots);
+    CountingSortJob job = {chunks, NULL, bucketable, slots};
+    parallelFor((size_t)parts, checkChunkJob, &job);
+    for (int i = 0; i < parts; i++){
+        if (!bucketable[i]) return 0;
+    }
+
+    job.bins = calloc((size_t)parts * RATING_BUCKETS, sizeof(BookList));
+    if (!job.bins) return 0;  // the merge sort needs no memory
+    parallelFor((size_t)parts, binChunkJob, &job);
 
-static Book* splitForSort(Book *head){
-    Book *fast = head, *slow = head;
-    while (fast && fast->next){
-        fast = fast->next->next;
-        if (fast) slow = slow->next;
+    *list = (BookList){0};
+    for (int b = 0; b < RATING_BUCKETS; b++){
+        for (int i = 0; i < parts; i++) concatLists(list, &job.bins[i * RATING_BUCKETS + b]);
     }
-    Book *second = slow->next;
-    slow->next = NULL;
-    return second;
+    free(job.bins);
+    return 1;
 }
 
 static Book* mergeByRating(Book *first, Book *second){
-    if (!first) return second;
-    if (!second) return first;
-    
-    if (first->rating <= second->rating){
-        first->next = mergeByRating(first->next, second);
-        return first;
+    Book *result = NULL, **link = &result;
+    while (first && second){
+        if (first->rating <= second->rating){
+            *link = first;
+            first = first->next;
+        }
+        else{
+            *link = second;
+            second = second->next;
+        }
+        link = &(*link)->next;
     }
-    else{
-        second->next = mergeByRating(first, second->next);
-        return second;
+    *link = first ? first : second;
+    return result;
+}
+
+// Iterative bottom-up merge sort: bins[i] holds a sorted run of 2^i nodes,
+// older runs always merge in as the first argument to keep the sort stable
+static Book* mergeSortIterative(Book *head){
+    Book *bins[SORT_BINS] = {NULL};
+    int top = 0;
+
+    while (head){
+        Book *run = head;
+        head = head->next;
+        run->next = NULL;
+
+        int i = 0;
+        while (i < SORT_BINS - 1 && bins[i]){
+            run = mergeByRating(bins[i], run);
+            bins[i++] = NULL;
+        }
+        bins[i] = bins[i] ? mergeByRating(bins[i], run) : run;
+        if (i > top) top = i;
+    }
+
+    Book *result = NULL;
+    for (int i = 0; i <= top; i++) result = mergeByRating(bins[i], result);
+    return result;
+}
+
+static void sortChunkJob(void *arg, size_t task){
+    BookList *chunk = (BookList *)arg + task;
+    chunk->tail->next = NULL;
+    chunk->head = mergeSortIterative(chunk->head);
+}
+
+// Orders runs by head rating; on a tie the earlier run wins, which keeps the
+// merge stable
+static int runBefore(const BookList *runs, int a, int b){
+    float x = runs[a].head->rating, y = runs[b].head->rating;
+    return x < y || (x == y && a < b);
+}
+
+static void siftRun(const BookList *runs, int *heap, int n){
+    int i = 0, run = heap[0];
+    while (2 * i + 1 < n){
+        int child = 2 * i + 1;
+        if (child + 1 < n && runBefore(runs, heap[child + 1], heap[child])) child++;
+        if (!runBefore(runs, heap[child], run)) break;
+        heap[i] = heap[child];
+        i = child;
     }
+    heap[i] = run;
 }
 
-static Book* mergeSortRecursive(Book *head){
-    if (!head || !head->next) return head;
-    
-    Book *second = splitForSort(head);
-    head = mergeSortRecursive(head);
-    second = mergeSortRecursive(second);
-    return mergeByRating(head, second);
+// Stable k-way merge of sorted runs that were cut from list in order;
+// rebuilds the back-links and the tail on the way
+static void mergeRuns(BookList *list, BookList *runs, int count){
+    int heap[MAX_WORKERS], n = 0;
+    for (int i = 0; i < count; i++){
+        if (!runs[i].head) continue;
+        int j = n++;
+        for (; j > 0 && runBefore(runs, i, heap[(j - 1) / 2]); j = (j - 1) / 2) heap[j] = heap[(j - 1) / 2];
+        heap[j] = i;
+    }
+
+    Book *prev = NULL;
+    while (n){
+        BookList *run = &runs[heap[0]];
+        Book *book = run->head;
+        run->head = book->next;
+        if (prev) prev->next = book;
+        else list->head = book;
+        book->prev = prev;
+        prev = book;
+        if (!run->head) heap[0] = heap[--n];
+        if (n) siftRun(runs, heap, n);
+    }
+    prev->next = NULL;
+    list->tail = prev;
 }
 
-void sortByRating(Book **head){
-    if (!*head || !(*head)->next){
-        printWarning("List has fewer than 2 books. No sorting needed.");
-        return;
+BookStatus sortByRating(Library *lib, char choice){
+    STATS_SCOPE(STAT_SORT);
+    BookList *list = getCurrentList(lib, choice);
+    if (!list->head || !list->head->next) return BOOK_OK;
+    ListLayout *layout = captureLayout(lib, slotBit(lib, list));
+    BookList chunks[MAX_WORKERS];
+    int parts = chunkList(list, chunks);
+    if (!countingSortByRating(list, chunks, parts, layout ? layout->order : NULL)){
+        parallelFor((size_t)parts, sortChunkJob, chunks);
+        mergeRuns(list, chunks, parts);
     }
-    *head = mergeSortRecursive(*head);
-    printSuccess("Books sorted by rating.");
+    lib->list_edits++;
+    recordLayout(lib, UNDO_SORT, layout);
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_SORT, choice);
+    return BOOK_OK;
 }
 
 // ============= SPLIT/MERGE =============
 
-void splitLibrary(Library *lib){
-    if (!lib){
-        printError("Library does not exist.");
-        return;
+static int bucketsEmpty(const Library *lib){
+    for (int i = 0; i < lib->bucket_count; i++){
+        if (lib->buckets[i].head) return 0;
+    }
+    return 1;
+}
+
+typedef struct{
+    const Library *lib;
+    BookList *chunks;
+    BookList *bins;  // MAX_BUCKETS per chunk
+    Book ***order;   // per chunk: where to save the order before partitioning, or NULL
+}PartitionJob;
+
+static void partitionChunkJob(void *arg, size_t task){
+    PartitionJob *job = arg;
+    BookList *bins = job->bins + task * MAX_BUCKETS;
+    Book *temp = job->chunks[task].head;
+    Book **order = job->order[task];
+    for (size_t i = 0; i < job->chunks[task].count; i++){
+        Book *next = temp->next;
+        if (order) order[i] = temp;
+        appendBook(&bins[bucketOf(job->lib, temp->rating)], temp);
+        temp = next;
+    }
+}
+
+// Moves the existing nodes of src into their buckets; no copies. Chunks are
+// partitioned in parallel and each bucket takes its pieces in chunk order.
+// The order of src is saved in order on the way, when given.
+static void distributeBooks(Library *lib, BookList *src, Book **order){
+    BookList chunks[MAX_WORKERS];
+    Book **slots[MAX_WORKERS];
+    int parts = chunkList(src, chunks);
+    chunkSlots(chunks, parts, order, slots);
+    PartitionJob job = {lib, chunks, calloc((size_t)parts * MAX_BUCKETS, sizeof(BookList)), slots};
+
+    if (job.bins){
+        STATS_BYTES((size_t)parts * MAX_BUCKETS * sizeof(BookList));
+        parallelFor((size_t)parts, partitionChunkJob, &job);
+        for (int b = 0; b < lib->bucket_count; b++){
+            for (int i = 0; i < parts; i++) concatLists(&lib->buckets[b], &job.bins[i * MAX_BUCKETS + b]);
+        }
+        free(job.bins);
     }
+    else{
+        Book *temp = src->head;
+        while (temp){
+            Book *next = temp->next;
+            if (order) *order++ = temp;
+            appendBook(&lib->buckets[bucketOf(lib, temp->rating)], temp);
+            temp = next;
+        }
+    }
+    *src = (BookList){0};
+    lib->list_edits++;
+}
+
+BookStatus setRatingBuckets(Library *lib, const float *cuts, int count){
+    STATS_SCOPE(STAT_BUCKETS);
+    if (count < 1 || count > MAX_BUCKETS - 1) return BOOK_BAD_CUT_COUNT;
 
+    // Highest cut first, so bucket 'a' always holds the best-rated books
+    float sorted[MAX_BUCKETS - 1];
+    for (int i = 0; i < count; i++){
+        if (!(cuts[i] > 0.0f && cuts[i] <= 5.0f)) return BOOK_BAD_CUT_RANGE;
+        int j = i;
+        for (; j > 0 && sorted[j - 1] < cuts[i]; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = cuts[i];
+    }
+    for (int i = 1; i < count; i++){
+        if (sorted[i] == sorted[i - 1]) return BOOK_DUPLICATE_CUT;
+    }
+
+    uint32_t buckets = 0;
     if (lib->is_split){
-        printWarning("Library is already split. Merge first before splitting again.");
-        return;
+        for (int i = 0; i < lib->bucket_count; i++) buckets |= slotBit(lib, &lib->buckets[i]);
     }
+    ListLayout *layout = captureLayout(lib, buckets);
 
-    if (!lib->main_list){
-        printError("Cannot split: main library is empty.");
-        return;
+    // Gather the buckets in order before the cuts change, then redistribute
+    BookList all = {0};
+    if (lib->is_split){
+        for (int i = 0; i < lib->bucket_count; i++) concatLists(&all, &lib->buckets[i]);
     }
+    memcpy(lib->cuts, sorted, (size_t)count * sizeof(float));
+    lib->bucket_count = count + 1;
+    if (lib->is_split) distributeBooks(lib, &all, layout ? layout->order : NULL);
 
-    Book *temp = lib->main_list;
-    Book *highTail = NULL, *lowTail = NULL;
+    recordLayout(lib, UNDO_BUCKETS, layout);
+    if (lib->journal) journalLogBuckets(lib->journal, lib->cuts, count);
+    return BOOK_OK;
+}
 
-    while (temp){
-        Book *newBook = malloc(sizeof(Book));
-        if (!newBook){
-            printError("Memory allocation failed during split.");
-            return;
-        }
+BookStatus splitLibrary(Library *lib){
+    STATS_SCOPE(STAT_SPLIT);
+    if (!lib) return BOOK_NO_LIBRARY;
+    if (lib->is_split) return BOOK_ALREADY_SPLIT;
+    if (!lib->main_list.head) return BOOK_LIST_EMPTY;
 
-        memcpy(newBook, temp, sizeof(Book));
-        newBook->next = NULL;
+    ListLayout *layout = captureLayout(lib, slotBit(lib, &lib->main_list));
+    distributeBooks(lib, &lib->main_list, layout ? layout->order : NULL);
+    lib->is_split = 1;  // last_added still points at a live node, so it survives
+    recordLayout(lib, UNDO_SPLIT, layout);
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_SPLIT, 'm');
+    return BOOK_OK;
+}
 
-        if (temp->rating >= 3.5f){
-            if (!lib->high_rated){
-                lib->high_rated = newBook;
-            }
-            else{
-                highTail->next = newBook;
-            }
-            highTail = newBook;
+BookStatus mergeLibrary(Library *lib){
+    STATS_SCOPE(STAT_MERGE);
+    if (!lib || !lib->is_split) return BOOK_NOT_SPLIT;
+
+    // The buckets keep their inner links in main_list, so undo only cuts them apart
+    ListLayout *layout = captureLayout(lib, 0);
+    if (bucketsEmpty(lib)){
+        lib->is_split = 0;
+        recordLayout(lib, UNDO_MERGE, layout);
+        if (lib->journal) journalLogOp(lib->journal, JOURNAL_MERGE, 'm');  // state still changed
+        return BOOK_BUCKETS_EMPTY;
+    }
+
+    for (int i = 0; i < lib->bucket_count; i++) concatLists(&lib->main_list, &lib->buckets[i]);
+    lib->is_split = 0;
+    lib->list_edits++;
+    recordLayout(lib, UNDO_MERGE, layout);
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_MERGE, 'm');
+    return BOOK_OK;
+}
+
+BookStatus freeLibraryList(Library *lib, char choice){
+    STATS_SCOPE(STAT_FREE);
+    BookList *list = getCurrentList(lib, choice);
+    if (!list->head) return BOOK_LIST_EMPTY;
+
+    clearUndoLog(lib);  // deleted nodes held for undo may point into this list
+    if (list == &lib->main_list){
+        // main_list holds every book when the library is not split, so the
+        // index and pool are dropped wholesale instead of node by node
+        indexClear(&lib->index);
+        poolReset(&lib->pool);
+        arenaReset(&lib->strings);
+        destroySearchIndex(lib->search);
+        lib->search = NULL;
+        lib->ratings = (RatingIndex){0};
+        topCacheInvalidate(lib->top);
+        isbnFilterReset(lib->filter, &lib->index);
+        lib->last_added = NULL;
+    }
+    else{
+        size_t count = 0;
+        for (Book *temp = list->head; temp; temp = temp->next){
+            indexRemove(&lib->index, temp->isbn);
+            forgetBook(lib, temp);
+            if (temp == lib->last_added) lib->last_added = NULL;
+            count++;
         }
-        else{
-            if (!lib->low_rated){
-                lib->low_rated = newBook;
-            }
-            else{
-                lowTail->next = newBook;
-            }
-            lowTail = newBook;
+        poolFreeRun(&lib->pool, list->head, list->tail, count);
+    }
+    *list = (BookList){0};
+    lib->list_edits++;
+
+    if (lib->is_split && bucketsEmpty(lib)) lib->is_split = 0;
+    if (lib->journal) journalLogOp(lib->journal, JOURNAL_FREE, choice);
+    return BOOK_OK;
+}
+// ============= DEFRAGMENTATION =============
+
+static uint64_t monotonicNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void measureBookLayout(const Library *lib, BookLayout *layout){
+    *layout = (BookLayout){0};
+    uint64_t start = monotonicNs();
+    for (int i = 0; i <= MAX_BUCKETS; i++){
+        const BookList *list = i ? &lib->buckets[i - 1] : &lib->main_list;
+        for (const Book *book = list->head; book; book = book->next){
+            if (book->next && book->next != book + 1) layout->jumps++;
         }
-        temp = temp->next;
+        layout->books += list->count;
     }
+    layout->walk_ns = monotonicNs() - start;
+
+    size_t chunks = 0;
+    for (const BookChunk *chunk = lib->pool.chunks; chunk; chunk = chunk->next) chunks++;
+    layout->pool_bytes = chunks * sizeof(BookChunk);
+    layout->idle_bytes = (chunks * POOL_CHUNK_BOOKS - lib->pool.live) * sizeof(Book);
+    layout->string_bytes = lib->strings.capacity + lib->strings.author_capacity * sizeof(InternSlot);
+    layout->dead_string_bytes = lib->strings.dead;
+}
 
-    freeBookList(lib->main_list);
-    lib->main_list = NULL;
-    lib->last_added = NULL;  // Clear last_added since we're working with split lists now
-    lib->is_split = 1;
-    printSuccess("Library split into high-rated (≥3.5★) and low-rated (<3.5★) books.");
+// While the pointers into the old nodes are being fixed, each old node's prev
+// names its copy
+static Book* movedTo(const Book *book){
+    return book ? book->prev : NULL;
 }
 
-void mergeLibrary(Library *lib){
-    if (!lib || !lib->is_split){
-        printError("Library is not split.");
-        return;
+BookStatus defragmentBooks(Library *lib){
+    STATS_SCOPE(STAT_DEFRAG);
+    if (!lib) return BOOK_NO_LIBRARY;
+    size_t total = 0;
+    for (int i = 0; i <= MAX_BUCKETS; i++) total += slotList(lib, i)->count;
+    if (!total){
+        compactStrings(lib, 1);
+        return BOOK_OK;
     }
 
-    if (!lib->high_rated && !lib->low_rated){
-        printError("Both split lists are empty.");
-        lib->is_split = 0;
-        return;
+    // Every chunk up front, so running out of memory changes nothing
+    BookPool fresh = {0};
+    for (size_t n = 0; n < total; n += POOL_CHUNK_BOOKS){
+        BookChunk *chunk = malloc(sizeof(BookChunk));
+        if (!chunk){
+            poolReset(&fresh);
+            return BOOK_NO_MEMORY;
+        }
+        STATS_BYTES(sizeof(BookChunk));
+        chunk->next = fresh.chunks;
+        fresh.chunks = chunk;
     }
+    clearUndoLog(lib);  // its nodes and layouts point into the old chunks
+    compactStrings(lib, 1);
 
-    if (!lib->high_rated){
-        lib->main_list = lib->low_rated;
+    BookChunk *chunk = fresh.chunks;
+    size_t used = 0;
+    for (int i = 0; i <= MAX_BUCKETS; i++){
+        BookList *list = slotList(lib, i);
+        Book *prev = NULL;
+        for (Book *book = list->head; book; book = book->next){
+            if (used == POOL_CHUNK_BOOKS){
+                chunk = chunk->next;
+                used = 0;
+            }
+            Book *copy = &chunk->books[used++];
+            *copy = *book;
+            copy->prev = prev;
+            if (prev) prev->next = copy;
+            book->prev = copy;
+            prev = copy;
+        }
+        if (prev){
+            list->head = movedTo(list->head);
+            list->tail = prev;
+        }
     }
-    else if (!lib->low_rated){
-        lib->main_list = lib->high_rated;
+
+    for (size_t s = 0; s < lib->index.capacity; s++){
+        lib->index.slots[s].book = movedTo(lib->index.slots[s].book);
     }
-    else{
-        Book *temp = lib->high_rated;
-        while (temp->next) temp = temp->next;
-        temp->next = lib->low_rated;
-        lib->main_list = lib->high_rated;
+    if (lib->ratings.built || lib->search){
+        for (int i = 0; i <= MAX_BUCKETS; i++){
+            for (Book *book = slotList(lib, i)->head; book; book = book->next){
+                if (lib->ratings.built){
+                    book->left = movedTo(book->left);
+                    book->right = movedTo(book->right);
+                }
+                if (lib->search) searchIndexMove(lib->search, book);
+            }
+        }
+        lib->ratings.root = movedTo(lib->ratings.root);
     }
+    lib->last_added = movedTo(lib->last_added);
+    topCacheInvalidate(lib->top);
 
-    lib->high_rated = NULL;
-    lib->low_rated = NULL;
-    lib->is_split = 0;
-    printSuccess("Library merged successfully.");
-}
\ No newline at end of file
+    // The chunks were filled from the head of the chain; the last one may be
+    // partly used, and poolAlloc carves from the head, so turn the chain around
+    BookChunk *reversed = NULL;
+    while (fresh.chunks){
+        BookChunk *next = fresh.chunks->next;
+        fresh.chunks->next = reversed;
+        reversed = fresh.chunks;
+        fresh.chunks = next;
+    }
+    poolReset(&lib->pool);
+    lib->pool = (BookPool){reversed, used, NULL, total};
+    lib->list_edits++;
+    return BOOK_OK;
+}
@@ -1,46 +1,209 @@
 #ifndef BOOK_H
 #define BOOK_H
 
-#define MAXNAME 100
+#include <stddef.h>
+#include <stdint.h>
 
-// Book structure
+#define SPLIT_RATING 3.5f  // default cut: books rated at or above this go to bucket 'a'
+#define MAX_BUCKETS 26     // split lists are named 'a', 'b', ... from the highest ratings down
+
+// Book structure; title and author live in the library's string arena
 typedef struct Book{
-    char title[MAXNAME];
-    char author[MAXNAME];
     long isbn;
-    float rating;  // 0.0 - 5.0
+    float rating;     // 0.0 - 5.0
+    uint32_t title;   // arena offset, use bookTitle()
+    uint32_t author;  // arena offset shared by every book of that author, use bookAuthor()
+    uint32_t doc;     // search index document id, meaningful only while lib->search exists
     struct Book *next;
+    struct Book *prev;  // back-link so indexed deletes can unlink in O(1)
+    struct Book *left;  // rating index links, meaningful only while lib->ratings is built
+    struct Book *right;
 }Book;
 
+// Open-addressing hash index mapping ISBN -> node, shared by all lists
+typedef struct{
+    long isbn;
+    Book *book;    // NULL marks an empty slot
+}IndexSlot;
+
+typedef struct{
+    IndexSlot *slots;
+    size_t capacity;  // always a power of two
+    size_t count;
+}IsbnIndex;
+
+// Append-only store for NUL-terminated strings, rewritten by compactStrings;
+// authors are interned
+typedef struct{
+    uint32_t offset;  // 0 marks an empty slot (offset 0 is never an author)
+    uint32_t hash;
+}InternSlot;
+
+typedef struct{
+    char *data;
+    size_t used;
+    size_t capacity;
+    size_t dead;            // bytes no book uses: deleted titles, or a loaded blob not yet claimed
+    InternSlot *authors;    // author string -> offset
+    size_t author_capacity; // always a power of two
+    size_t author_count;
+}StringArena;
+
+// Slab allocator handing out Book nodes from contiguous chunks
+typedef struct{
+    struct BookChunk *chunks;  // newest chunk first
+    size_t used;               // nodes carved from the newest chunk so far
+    Book *free_list;           // recycled nodes, linked through next
+    size_t live;               // nodes currently handed out
+}BookPool;
+
+// Treap over (rating, ISBN) threaded through Book.left/right; built on the
+// first range query and kept up to date on every insert and delete after that
+typedef struct{
+    Book *root;
+    int built;
+}RatingIndex;
+
+// Ratings are summed in fixed point, in units of 2^-80. Every rating above
+// 2^-57 converts exactly, so a sum does not depend on the order it was built
+// in: deletes leave no drift and chunks summed by different threads add up to
+// the single-threaded result.
+typedef __int128 RatingSum;
+#define RATING_SUM_UNIT 0x1p80
+
+// Doubly linked list that knows its tail, so appends and merges are O(1)
+typedef struct{
+    Book *head;
+    Book *tail;
+    size_t count;          // maintained on every link/unlink
+    RatingSum rating_sum;  // running sum, so averages are O(1) reads
+}BookList;
+
 // Library management structure
 typedef struct{
-    Book *main_list;
-    Book *high_rated;
-    Book *low_rated;
+    BookList main_list;
+    BookList buckets[MAX_BUCKETS];  // split lists; bucket 0 holds the highest ratings
+    float cuts[MAX_BUCKETS - 1];    // lowest rating of each bucket but the last, descending
+    int bucket_count;
     Book *last_added;  // variable to track the most recently added book
     int is_split;      // indicates if the library is split 
+    IsbnIndex index;   // ISBN lookups across main_list and every bucket
+    RatingIndex ratings;
+    BookPool pool;     // owns the memory of every Book in the library
+    StringArena strings;  // titles and interned authors
+    struct SearchIndex *search;  // title/author index, built on the first search
+    struct TopCache *top;        // live top-K cache, NULL unless enabled
+    struct IsbnFilter *filter;   // Bloom filter in front of index, NULL unless enabled
+    struct LibraryLock *lock;    // reader-writer lock, NULL unless shared access is enabled
+    struct Journal *journal;  // write-ahead journal, NULL when not durable
+    uint64_t journal_lsn;     // last journal record reflected in this state
+    uint64_t list_edits;      // bumped when books leave or change places, so saved cursors can tell
+    struct UndoLog *undo;     // recent changes that can be reversed, NULL until the first one
 }Library;
 
-// Library management
+// Result of a core operation. The core never prints: callers turn a status
+// into a message themselves (see formatStatus in cli_utils.h).
+typedef enum{
+    BOOK_OK = 0,
+    BOOK_NO_LIBRARY,
+    BOOK_NO_MEMORY,
+    BOOK_DUPLICATE,       // ISBN already in the library
+    BOOK_NOT_FOUND,       // ISBN not in the chosen list
+    BOOK_LIST_EMPTY,
+    BOOK_NO_LAST_ADDED,   // last added book was deleted, or none was added
+    BOOK_ALREADY_SPLIT,
+    BOOK_NOT_SPLIT,
+    BOOK_BUCKETS_EMPTY,   // merge found nothing to merge, but the library is no longer split
+    BOOK_BAD_CUT_COUNT,
+    BOOK_BAD_CUT_RANGE,
+    BOOK_DUPLICATE_CUT,
+    BOOK_NOTHING_TO_UNDO
+}BookStatus;
+
+// Library management; NULL when memory runs out
 Library* createLibrary(void);
 void destroyLibrary(Library *lib);
 
-// Book operations
-Book* addBook(Library *lib, const char *title, const char *author, long isbn, float rating);
-void displayBooks(Book *head, const char *list_name);
-Book* findBook(Book *head, long isbn);
-void deleteLastAddedBook(Library *lib);
-void deleteBookByISBN(Book **head, long isbn);
-int countBooks(Book *head);
-float averageRating(Book *head);
+// Book operations. On BOOK_OK from addBook the new node is lib->last_added.
+BookStatus addBook(Library *lib, const char *title, const char *author, long isbn, float rating);
+Book* findBook(Library *lib, char choice, long isbn);  // NULL unless isbn is in that list
+Book* lookupBook(Library *lib, long isbn);             // searches every list
+BookStatus deleteLastAddedBook(Library *lib);
+BookStatus deleteBookByISBN(Library *lib, char choice, long isbn);
+size_t countBooks(const BookList *list);
+double averageRating(const BookList *list);
+double meanRating(RatingSum sum, size_t count);  // 0.0 when count is 0
+
+// Bulk loading (snapshots, imports): NULL on duplicate ISBN or no memory
+int reserveBooks(Library *lib, size_t count);
+Book* loadBook(Library *lib, char choice, const char *title, const char *author, long isbn, float rating);
+
+// Snapshot fast path: adopt a whole string blob, then link books by offset into it
+int loadStrings(Library *lib, const char *data, size_t size);
+Book* loadBookByOffset(Library *lib, char choice, long isbn, float rating, uint32_t title, uint32_t author);
+
+// String access; pointers stay valid until the next insert grows or compacts the arena
+const char* bookTitle(const Library *lib, const Book *book);
+const char* bookAuthor(const Library *lib, const Book *book);
+
+// List operations; sorting a list of fewer than 2 books is a BOOK_OK no-op
+BookStatus sortByRating(Library *lib, char choice);
+BookStatus splitLibrary(Library *lib);
+BookStatus mergeLibrary(Library *lib);
+BookStatus freeLibraryList(Library *lib, char choice);
+
+// Rating buckets: count cuts in (0, 5] make count + 1 buckets. While split the
+// books are redistributed in one pass.
+BookStatus setRatingBuckets(Library *lib, const float *cuts, int count);
+
+// Undo: adds, deletes, sorts, splits, merges and bucket changes are logged
+// so the last UNDO_MAX_STEPS of them can be reversed, newest first. A book
+// step costs O(1); a list-wide step relinks the lists it reordered. Freeing a
+// list, loading a snapshot, compacting the journal and defragmenting clear
+// the history.
+#define UNDO_MAX_STEPS 256
+BookStatus undoLastChange(Library *lib);
+const char* nextUndoName(const Library *lib);  // "add", "delete", ...; NULL when there is nothing to undo
+size_t undoSteps(const Library *lib);
+void clearUndoLog(Library *lib);
+
+// Node layout. Adds, deletes and sorts leave list order unrelated to where
+// the nodes sit in the pool, and then every list walk is a chain of cache misses.
+typedef struct{
+    size_t books;
+    size_t jumps;        // links to any node but the next one in memory
+    size_t pool_bytes;   // chunk memory the pool holds
+    size_t idle_bytes;   // of it, nodes neither in a list nor held for undo
+    size_t string_bytes; // string arena and author table
+    size_t dead_string_bytes;
+    uint64_t walk_ns;    // time the measuring walk over every list took
+}BookLayout;
+
+// Walks every list in order; jumps / books says how scattered the lists are
+void measureBookLayout(const Library *lib, BookLayout *layout);
+
+// Rewrites the string arena with only the strings books still use, titles in
+// list order, and returns the bytes given back. Unless force is set it only
+// runs once dead strings fill half the arena and at least 64 KB; adds check
+// that on their own, and so do snapshot saves and journal compaction.
+// Running out of memory leaves the arena as it was and returns 0.
+size_t compactStrings(Library *lib, int force);
+
+// Copies every book into fresh chunks in list order (main_list, then the
+// buckets) and frees the old ones, so walks read memory front to back, then
+// compacts the strings. The lists, last_added and the indexes follow the
+// books and the top cache is refilled on its next query. Clears the undo history. The contents do not
+// change, so nothing is journaled; BOOK_NO_MEMORY leaves the library as it was.
+BookStatus defragmentBooks(Library *lib);
 
-// List operations
-void sortByRating(Book **head);
-void splitLibrary(Library *lib);
-void mergeLibrary(Library *lib);
+// Books rated in [lo, hi), ascending by rating then ISBN, as a malloc'd array
+// of *count books (NULL when there are none); 0 only when memory runs out
+int booksInRatingRange(Library *lib, float lo, float hi, Book ***results, size_t *count);
 
 // Helper functions for main.c
-Book* getCurrentList(Library *lib, char choice);
-Book** getCurrentListPtr(Library *lib, char choice);
+BookList* getCurrentList(Library *lib, char choice);
+char listChoiceOf(const Library *lib, const Book *book);
+char listForRating(const Library *lib, float rating);  // 'm', or the bucket while split
+int isListChoice(const Library *lib, char choice);     // 'm' or a configured bucket
 
 #endif // BOOK_H
\ No newline at end of file
@@ -1,6 +1,14 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include "cli_utils.h"
+#include "export.h"
+
+#define MAXMESSAGE 256
+#define DISPLAY_PAGE 20  // books per screen in the menu
+
+static int messagesOn = 1;
+static _Thread_local char lastMessageBuf[MAXMESSAGE];  // per thread, for shared libraries
 
 // ============= DISPLAY FUNCTIONS =============
 
@@ -18,20 +26,134 @@ void displayMenu(void){
     printf("8. Sort Books by Rating\n");
     printf("9. Get Average Rating\n");
     printf("10. Free Library List\n");
-    printf("11. Exit\n");
+    printf("11. Save Library Snapshot\n");
+    printf("12. Load Library Snapshot\n");
+    printf("13. Import Books (CSV/JSONL)\n");
+    printf("14. Compact Journal\n");
+    printf("15. Search by Title/Author\n");
+    printf("16. Books in Rating Range\n");
+    printf("17. Set Rating Buckets\n");
+    printf("18. Top/Bottom Rated Books\n");
+    printf("19. Export Books\n");
+    printf("20. Operation Statistics\n");
+    printf("21. Undo Last Change\n");
+    printf("22. Defragment Book Memory\n");
+    printf("23. Exit\n");
     printf(BOLD"==================================\n"RESET);
 }
 
-void printSuccess(const char *message){
-    printf(BOLD GREEN"%s\n"RESET, message);
+// Rating range of a bucket: "≥3.5★", "2-3.5★" or "<2★"
+void formatBucket(const Library *lib, char choice, char *buffer, size_t size){
+    int i = choice - 'a', last = lib->bucket_count - 1;
+    if (i == 0) snprintf(buffer, size, "≥%g★", lib->cuts[0]);
+    else if (i == last) snprintf(buffer, size, "<%g★", lib->cuts[last - 1]);
+    else snprintf(buffer, size, "%g-%g★", lib->cuts[i], lib->cuts[i - 1]);
+}
+
+// Pages through the list; the cursor steps from page to page, so a late page
+// costs no more than the first
+void displayBooks(Library *lib, char choice, const char *list_name){
+    BookCursor cursor;
+    cursorOpen(&cursor, lib, choice);
+    size_t total = cursor.list->count;
+    if (!total){
+        printf(BOLD RED"No books in %s.\n"RESET, list_name);
+        return;
+    }
+
+    printf(BOLD BLUE"\n=== %s ===\n"RESET, list_name);
+    while (1){
+        size_t start = cursor.position;
+        exportBooks(lib, &cursor, DISPLAY_PAGE, EXPORT_TERMINAL, stdout);
+        if (start == 0 && cursor.position == total) return;  // fits on one page
+
+        char input[10];
+        printf(BOLD YELLOW"Books %zu-%zu of %zu. Enter for more, p for previous, q to stop: "RESET,
+               start + 1, cursor.position, total);
+        if (!fgets(input, sizeof(input), stdin) || input[0] == 'q') return;
+        if (input[0] == 'p') cursorSeek(&cursor, lib, start >= DISPLAY_PAGE ? start - DISPLAY_PAGE : 0);
+        else if (cursor.position == total) return;
+    }
+}
+
+// Message for a core status; isbn is only used by the duplicate and not-found cases
+void formatStatus(BookStatus status, long isbn, char *buffer, size_t size){
+    switch (status){
+        case BOOK_OK:            snprintf(buffer, size, "Done."); break;
+        case BOOK_NO_LIBRARY:    snprintf(buffer, size, "Library does not exist."); break;
+        case BOOK_NO_MEMORY:     snprintf(buffer, size, "Memory allocation failed!"); break;
+        case BOOK_DUPLICATE:     snprintf(buffer, size, "Book with ISBN %ld already exists!", isbn); break;
+        case BOOK_NOT_FOUND:     snprintf(buffer, size, "Book with ISBN %ld not found.", isbn); break;
+        case BOOK_LIST_EMPTY:    snprintf(buffer, size, "List is empty."); break;
+        case BOOK_NO_LAST_ADDED: snprintf(buffer, size, "No record of last added book. Use delete by ISBN instead."); break;
+        case BOOK_ALREADY_SPLIT: snprintf(buffer, size, "Library is already split. Merge first before splitting again."); break;
+        case BOOK_NOT_SPLIT:     snprintf(buffer, size, "Library is not split."); break;
+        case BOOK_BUCKETS_EMPTY: snprintf(buffer, size, "All split lists are empty."); break;
+        case BOOK_BAD_CUT_COUNT: snprintf(buffer, size, "Give between 1 and %d rating cuts.", MAX_BUCKETS - 1); break;
+        case BOOK_BAD_CUT_RANGE: snprintf(buffer, size, "Rating cuts must be above 0.0 and at most 5.0."); break;
+        case BOOK_DUPLICATE_CUT: snprintf(buffer, size, "Rating cuts must be distinct."); break;
+        case BOOK_NOTHING_TO_UNDO: snprintf(buffer, size, "Nothing to undo."); break;
+        default:                 snprintf(buffer, size, "Unknown error."); break;
+    }
+}
+
+void setMessagesEnabled(int enabled){
+    messagesOn = enabled;
+}
+
+int messagesEnabled(void){
+    return messagesOn;
+}
+
+const char* lastMessage(void){
+    return lastMessageBuf;
+}
+
+void printSuccess(const char *format, ...){
+    if (!messagesOn) return;
+    va_list args;
+    va_start(args, format);
+    printf(BOLD GREEN);
+    vprintf(format, args);
+    printf("\n"RESET);
+    va_end(args);
+}
+
+// Errors and warnings are formatted once into lastMessageBuf, even when muted
+static void printRecorded(const char *color, const char *format, va_list args){
+    vsnprintf(lastMessageBuf, sizeof(lastMessageBuf), format, args);
+    if (messagesOn) printf(BOLD"%s%s\n"RESET, color, lastMessageBuf);
+}
+
+void printError(const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    printRecorded(RED, format, args);
+    va_end(args);
+}
+
+void printWarning(const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    printRecorded(YELLOW, format, args);
+    va_end(args);
 }
 
-void printError(const char *message){
-    printf(BOLD RED"%s\n"RESET, message);
+// Refusing to split again is only a warning; everything else is an error
+void printStatus(BookStatus status, long isbn){
+    char message[MAXMESSAGE];
+    formatStatus(status, isbn, message, sizeof(message));
+    if (status == BOOK_ALREADY_SPLIT) printWarning("%s", message);
+    else printError("%s", message);
 }
 
-void printWarning(const char *message){
-    printf(BOLD YELLOW"%s\n"RESET, message);
+void printInfo(const char *format, ...){
+    if (!messagesOn) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
 }
 
 // ============= INPUT VALIDATION =============
@@ -97,11 +219,41 @@ void getString(const char *prompt, char *buffer, int size){
     }
 }
 
-char getListChoice(void){
+char getListChoice(const Library *lib){
+    char input[10], label[64];
+    char last = (char)('a' + lib->bucket_count - 1);
+    while (1){
+        for (char choice = 'a'; choice <= last; choice++){
+            formatBucket(lib, choice, label, sizeof(label));
+            printf(BOLD"%c. Books rated %s\n"RESET, choice, label);
+        }
+        printf(BOLD YELLOW"Choose list (a-%c): "RESET, last);
+        if (fgets(input, sizeof(input), stdin) && 
+            input[0] >= 'a' && input[0] <= last && input[1] == '\n'){
+            return input[0];
+        }
+        printError("Invalid choice. Enter a letter from 'a' to '%c'.", last);
+    }
+}
+
+char getSearchChoice(void){
+    char input[10];
+    while (1){
+        printf(BOLD"a. Starts with\nb. Contains\n"RESET);
+        printf(BOLD YELLOW"Choose match (a/b): "RESET);
+        if (fgets(input, sizeof(input), stdin) && 
+            (input[0] == 'a' || input[0] == 'b') && input[1] == '\n'){
+            return input[0];
+        }
+        printError("Invalid choice. Enter 'a' or 'b'.");
+    }
+}
+
+char getRankChoice(void){
     char input[10];
     while (1){
-        printf(BOLD"a. High-rated books (≥3.5★)\nb. Low-rated books (<3.5★)\n"RESET);
-        printf(BOLD YELLOW"Choose list (a/b): "RESET);
+        printf(BOLD"a. Highest rated\nb. Lowest rated\n"RESET);
+        printf(BOLD YELLOW"Choose order (a/b): "RESET);
         if (fgets(input, sizeof(input), stdin) && 
             (input[0] == 'a' || input[0] == 'b') && input[1] == '\n'){
             return input[0];
@@ -110,6 +262,19 @@ char getListChoice(void){
     }
 }
 
+char getExportChoice(void){
+    char input[10];
+    while (1){
+        printf(BOLD"a. Plain text\nb. CSV\nc. JSON Lines\n"RESET);
+        printf(BOLD YELLOW"Choose format (a/b/c): "RESET);
+        if (fgets(input, sizeof(input), stdin) && 
+            input[0] >= 'a' && input[0] <= 'c' && input[1] == '\n'){
+            return input[0];
+        }
+        printError("Invalid choice. Enter 'a', 'b' or 'c'.");
+    }
+}
+
 char getSplitMergeChoice(void){
     char input[10];
     while (1){
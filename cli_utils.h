@@ -1,6 +1,9 @@
 #ifndef CLI_UTILS_H
 #define CLI_UTILS_H
 
+#include <stddef.h>
+#include "book.h"
+
 #define RESET   "\033[0m"
 #define BOLD    "\033[1m"
 #define RED     "\033[31m"
@@ -8,11 +11,26 @@
 #define YELLOW  "\033[33m"
 #define BLUE    "\033[34m"
 
+#define PRINTF_LIKE __attribute__((format(printf, 1, 2)))
+
 // Menu and display
 void displayMenu(void);
-void printSuccess(const char *message);
-void printError(const char *message);
-void printWarning(const char *message);
+void printSuccess(const char *format, ...) PRINTF_LIKE;
+void printError(const char *format, ...) PRINTF_LIKE;
+void printWarning(const char *format, ...) PRINTF_LIKE;
+void printInfo(const char *format, ...) PRINTF_LIKE;
+void formatBucket(const Library *lib, char choice, char *buffer, size_t size);
+void displayBooks(Library *lib, char choice, const char *list_name);
+
+// Turning core status codes into messages
+void formatStatus(BookStatus status, long isbn, char *buffer, size_t size);
+void printStatus(BookStatus status, long isbn);  // error, or a warning for BOOK_ALREADY_SPLIT
+
+// Muting for non-interactive callers; errors and warnings are still
+// recorded so the caller can report them its own way
+void setMessagesEnabled(int enabled);
+int messagesEnabled(void);
+const char* lastMessage(void);
 
 // Input validation functions
 int getChoice(void);
@@ -20,7 +38,10 @@ int getPositiveInteger(const char *prompt);
 long getLong(const char *prompt);
 float getRating(const char *prompt);
 void getString(const char *prompt, char *buffer, int size);
-char getListChoice(void);
+char getListChoice(const Library *lib);
 char getSplitMergeChoice(void);
+char getSearchChoice(void);
+char getRankChoice(void);
+char getExportChoice(void);
 
 #endif // UI_UTILS_H
\ No newline at end of file
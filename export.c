@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "cli_utils.h"
+
+#define EXPORT_BUFFER (1 << 16)
+
+// Records are formatted here and reach the stream in EXPORT_BUFFER-sized
+// writes; one buffer per thread so shared readers can export side by side
+typedef struct{
+    FILE *out;
+    size_t used;
+    char data[EXPORT_BUFFER];
+}ExportBuffer;
+
+static _Thread_local ExportBuffer exportBuf;
+
+// ============= CURSOR =============
+
+void cursorOpen(BookCursor *cursor, Library *lib, char choice){
+    cursor->list = getCurrentList(lib, choice);
+    cursor->node = cursor->list->head;
+    cursor->position = 0;
+    cursor->edits = lib->list_edits;
+}
+
+static size_t distance(size_t a, size_t b){
+    return a > b ? a - b : b - a;
+}
+
+void cursorSeek(BookCursor *cursor, const Library *lib, size_t position){
+    size_t count = cursor->list->count;
+    if (position >= count){
+        cursor->node = NULL;
+        cursor->position = count;
+        cursor->edits = lib->list_edits;
+        return;
+    }
+
+    const Book *node = cursor->list->head;
+    size_t at = 0;
+    if (count - 1 - position < position){
+        node = cursor->list->tail;
+        at = count - 1;
+    }
+    if (cursor->node && cursor->edits == lib->list_edits && distance(cursor->position, position) < distance(at, position)){
+        node = cursor->node;
+        at = cursor->position;
+    }
+    for (; at < position; at++) node = node->next;
+    for (; at > position; at--) node = node->prev;
+
+    cursor->node = node;
+    cursor->position = position;
+    cursor->edits = lib->list_edits;
+}
+
+// ============= BUFFERED OUTPUT =============
+
+static void flushBuffer(ExportBuffer *buf){
+    if (buf->used) fwrite(buf->data, 1, buf->used, buf->out);
+    buf->used = 0;
+}
+
+static void putBytes(ExportBuffer *buf, const char *text, size_t len){
+    while (len){
+        if (buf->used == EXPORT_BUFFER) flushBuffer(buf);
+        size_t n = EXPORT_BUFFER - buf->used;
+        if (n > len) n = len;
+        memcpy(buf->data + buf->used, text, n);
+        buf->used += n;
+        text += n;
+        len -= n;
+    }
+}
+
+static void putText(ExportBuffer *buf, const char *text){
+    putBytes(buf, text, strlen(text));
+}
+
+static void putChar(ExportBuffer *buf, char c){
+    if (buf->used == EXPORT_BUFFER) flushBuffer(buf);
+    buf->data[buf->used++] = c;
+}
+
+static void putLong(ExportBuffer *buf, long value){
+    char digits[24];
+    size_t pos = sizeof(digits);
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    do{
+        digits[--pos] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    }while (magnitude);
+    if (value < 0) digits[--pos] = '-';
+    putBytes(buf, digits + pos, sizeof(digits) - pos);
+}
+
+// Ratings are almost always entered with one decimal; those are written
+// digit by digit, giving the same text as printf's "%g" (or "%.1f" when
+// always_decimal is set). Anything else goes through snprintf, as the
+// shortest of %g and %.9g that reads back as the same float, so exports can
+// be imported again without losing digits.
+static void putRating(ExportBuffer *buf, float rating, int always_decimal){
+    long tenths = rating >= 0.0f && rating <= 5.0f ? (long)(rating * 10.0f + 0.5f) : -1;
+    if (tenths < 0 || (float)tenths / 10.0f != rating){
+        char number[32];
+        if (always_decimal) snprintf(number, sizeof(number), "%.1f", rating);
+        else{
+            snprintf(number, sizeof(number), "%g", rating);
+            if (strtof(number, NULL) != rating) snprintf(number, sizeof(number), "%.9g", rating);
+        }
+        putText(buf, number);
+        return;
+    }
+    putChar(buf, (char)('0' + tenths / 10));
+    if (always_decimal || tenths % 10){
+        putChar(buf, '.');
+        putChar(buf, (char)('0' + tenths % 10));
+    }
+}
+
+// Copies runs of characters that need no escaping in one go; escape says
+// which characters do
+static void putEscaped(ExportBuffer *buf, const char *text, const char *escape,
+                       void (*putSpecial)(ExportBuffer *, char)){
+    while (*text){
+        size_t run = strcspn(text, escape);
+        putBytes(buf, text, run);
+        text += run;
+        if (*text) putSpecial(buf, *text++);
+    }
+}
+
+// Tabs and line breaks would split a TSV record, so they become spaces
+static void putTsvSpecial(ExportBuffer *buf, char c){
+    (void)c;
+    putChar(buf, ' ');
+}
+
+static void putCsvSpecial(ExportBuffer *buf, char c){
+    if (c == '"') putChar(buf, '"');
+    putChar(buf, c);
+}
+
+static void putJsonSpecial(ExportBuffer *buf, char c){
+    static const char hex[] = "0123456789abcdef";
+    putChar(buf, '\\');
+    switch (c){
+        case '"':  putChar(buf, '"'); break;
+        case '\\': putChar(buf, '\\'); break;
+        case '\n': putChar(buf, 'n'); break;
+        case '\r': putChar(buf, 'r'); break;
+        case '\t': putChar(buf, 't'); break;
+        default:
+            putText(buf, "u00");
+            putChar(buf, hex[(unsigned char)c >> 4]);
+            putChar(buf, hex[(unsigned char)c & 0xF]);
+    }
+}
+
+static const char jsonEscapes[] = "\"\\\x01\x02\x03\x04\x05\x06\x07\x08\t\n\x0b\x0c\r\x0e\x0f"
+                                  "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f";
+
+// CSV fields are quoted only when they hold a delimiter, a quote or a line break
+static void putCsvField(ExportBuffer *buf, const char *text){
+    if (!text[strcspn(text, ",\"\r\n")]){
+        putText(buf, text);
+        return;
+    }
+    putChar(buf, '"');
+    putEscaped(buf, text, "\"", putCsvSpecial);
+    putChar(buf, '"');
+}
+
+// ============= RECORDS =============
+
+static void putRecord(ExportBuffer *buf, const Library *lib, const Book *book, size_t number, ExportFormat format){
+    const char *title = bookTitle(lib, book), *author = bookAuthor(lib, book);
+    switch (format){
+        case EXPORT_TERMINAL:
+        case EXPORT_PLAIN:
+            if (format == EXPORT_TERMINAL) putText(buf, BOLD);
+            putLong(buf, (long)number);
+            putText(buf, ". Title: ");
+            putText(buf, title);
+            if (format == EXPORT_TERMINAL) putText(buf, RESET);
+            putText(buf, "\n   Author: ");
+            putText(buf, author);
+            putText(buf, " | ISBN: ");
+            putLong(buf, book->isbn);
+            putText(buf, " | Rating: ");
+            putRating(buf, book->rating, 1);
+            putText(buf, "★\n");
+            break;
+        case EXPORT_TSV:
+            putLong(buf, book->isbn);
+            putChar(buf, '\t');
+            putRating(buf, book->rating, 0);
+            putChar(buf, '\t');
+            putEscaped(buf, title, "\t\r\n", putTsvSpecial);
+            putChar(buf, '\t');
+            putEscaped(buf, author, "\t\r\n", putTsvSpecial);
+            putChar(buf, '\n');
+            break;
+        case EXPORT_CSV:
+            putCsvField(buf, title);
+            putChar(buf, ',');
+            putCsvField(buf, author);
+            putChar(buf, ',');
+            putLong(buf, book->isbn);
+            putChar(buf, ',');
+            putRating(buf, book->rating, 0);
+            putChar(buf, '\n');
+            break;
+        case EXPORT_JSON:
+            putText(buf, "{\"title\":\"");
+            putEscaped(buf, title, jsonEscapes, putJsonSpecial);
+            putText(buf, "\",\"author\":\"");
+            putEscaped(buf, author, jsonEscapes, putJsonSpecial);
+            putText(buf, "\",\"isbn\":");
+            putLong(buf, book->isbn);
+            putText(buf, ",\"rating\":");
+            putRating(buf, book->rating, 0);
+            putText(buf, "}\n");
+            break;
+    }
+}
+
+void exportBegin(FILE *out){
+    exportBuf.out = out;
+    exportBuf.used = 0;
+}
+
+void exportRecord(const Library *lib, const Book *book, size_t number, ExportFormat format){
+    putRecord(&exportBuf, lib, book, number, format);
+}
+
+void exportEnd(void){
+    flushBuffer(&exportBuf);
+}
+
+size_t exportBooks(const Library *lib, BookCursor *cursor, size_t limit, ExportFormat format, FILE *out){
+    ExportBuffer *buf = &exportBuf;
+    exportBegin(out);
+
+    // A stale cursor finds its place again before anything is read through
+    // it, as does one left past the end of a list that has grown since
+    if (cursor->edits != lib->list_edits || (!cursor->node && cursor->position < cursor->list->count)){
+        cursorSeek(cursor, lib, cursor->position);
+    }
+
+    size_t written = 0;
+    const Book *book = cursor->node;
+    for (; book && written < limit; book = book->next, written++){
+        putRecord(buf, lib, book, cursor->position + written + 1, format);
+    }
+    exportEnd();
+
+    cursor->node = book;
+    cursor->position += written;
+    return written;
+}
+
+size_t exportLibrary(Library *lib, char choice, ExportFormat format, FILE *out){
+    BookCursor cursor;
+    if (choice || !lib->is_split){
+        cursorOpen(&cursor, lib, choice ? choice : 'm');
+        return exportBooks(lib, &cursor, SIZE_MAX, format, out);
+    }
+    size_t written = 0;
+    for (int i = 0; i < lib->bucket_count; i++){
+        cursorOpen(&cursor, lib, (char)('a' + i));
+        written += exportBooks(lib, &cursor, SIZE_MAX, format, out);
+    }
+    return written;
+}
+
+void exportHeader(ExportFormat format, FILE *out){
+    if (format == EXPORT_CSV) fputs("title,author,isbn,rating\n", out);
+}
+
+int parseExportFormat(const char *name, ExportFormat *format){
+    if (strcmp(name, "plain") == 0) *format = EXPORT_PLAIN;
+    else if (strcmp(name, "tsv") == 0) *format = EXPORT_TSV;
+    else if (strcmp(name, "csv") == 0) *format = EXPORT_CSV;
+    else if (strcmp(name, "json") == 0) *format = EXPORT_JSON;
+    else return 0;
+    return 1;
+}
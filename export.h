@@ -0,0 +1,55 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "book.h"
+
+// Record layouts for display and export; only EXPORT_TERMINAL adds colour
+typedef enum{
+    EXPORT_TERMINAL,  // the numbered menu layout, with colour
+    EXPORT_PLAIN,     // the same layout without colour
+    EXPORT_TSV,       // isbn<TAB>rating<TAB>title<TAB>author, as in batch replies
+    EXPORT_CSV,       // title,author,isbn,rating, readable by --import
+    EXPORT_JSON       // one JSON object per line, readable by --import
+}ExportFormat;
+
+// Position in one list. A cursor survives books being appended; once books
+// leave or move between lists (lib->list_edits changes) the next seek starts
+// again from the nearer end of the list instead of from the old node.
+typedef struct{
+    const BookList *list;
+    const Book *node;   // book at position, NULL past the end
+    size_t position;    // 0-based
+    uint64_t edits;     // lib->list_edits when node was taken
+}BookCursor;
+
+// Opens at the first book of list choice ('m' or a bucket)
+void cursorOpen(BookCursor *cursor, Library *lib, char choice);
+
+// Moves to position (past the end is allowed), walking from whichever of the
+// head, the tail and the current node is closest
+void cursorSeek(BookCursor *cursor, const Library *lib, size_t position);
+
+// Formats up to limit books from the cursor into a 64 KB buffer that is
+// flushed with one fwrite whenever it fills, and advances the cursor past
+// them. Returns the number written; check ferror(out) for write errors.
+size_t exportBooks(const Library *lib, BookCursor *cursor, size_t limit, ExportFormat format, FILE *out);
+
+// The same buffered output for books gathered by the caller, e.g. merged
+// from several libraries: begin, one call per book, then end to flush
+void exportBegin(FILE *out);
+void exportRecord(const Library *lib, const Book *book, size_t number, ExportFormat format);
+void exportEnd(void);
+
+// Every book of list choice, or of the whole library when choice is 0 (main
+// list, or bucket by bucket while split); returns the number written
+size_t exportLibrary(Library *lib, char choice, ExportFormat format, FILE *out);
+
+// CSV column names; nothing for the other formats
+void exportHeader(ExportFormat format, FILE *out);
+
+// "plain", "tsv", "csv" or "json"; 0 if unknown
+int parseExportFormat(const char *name, ExportFormat *format);
+
+#endif // EXPORT_H
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "filter.h"
+#include "stats.h"
+
+// Blocked Bloom filter: an ISBN picks one 512-bit block and sets
+// FILTER_HASHES bits inside it. Blocks come in powers of two, so a filter
+// holds 12 to 24 bits per ISBN; at 12 about half a percent of absent ISBNs
+// get through, at 17 (a million books) about 0.2%.
+#define FILTER_BLOCK_WORDS  8     // 64-bit words per block, one cache line
+#define FILTER_BITS_PER_KEY 12    // fill limit before the filter is rebuilt larger
+#define FILTER_HASHES       6
+#define FILTER_MIN_BLOCKS   64
+#define FILTER_STRIPES      16    // counter copies, one cache line each
+
+typedef struct{
+    uint64_t words[FILTER_BLOCK_WORDS];
+}__attribute__((aligned(64))) FilterBlock;
+
+typedef struct{
+    _Atomic uint64_t checks;
+    _Atomic uint64_t skipped;
+    _Atomic uint64_t false_positives;
+}__attribute__((aligned(64))) FilterCounters;
+
+struct IsbnFilter{
+    FilterBlock *blocks;  // NULL after a failed rebuild: every check then says "maybe"
+    size_t block_count;   // always a power of two
+    int block_shift;      // 64 - log2(block_count)
+    size_t keys;
+    size_t stale;
+    size_t rebuilds;
+    FilterCounters counters[FILTER_STRIPES];
+};
+
+// Threads take stripes round-robin on their first check
+static _Atomic unsigned nextStripe;
+static _Thread_local int myStripe = -1;
+
+static FilterCounters* stripe(IsbnFilter *filter){
+    if (myStripe < 0) myStripe = (int)(atomic_fetch_add_explicit(&nextStripe, 1, memory_order_relaxed) % FILTER_STRIPES);
+    return &filter->counters[myStripe];
+}
+
+// A different mix from the index's, so filter and index collisions are unrelated
+static uint64_t filterHash(long isbn){
+    uint64_t x = (uint64_t)isbn + 0x9E3779B97F4A7C15ull;  // splitmix64
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// The high bits pick the block; a 9-bit start and an odd 9-bit stride from
+// the low bits pick the bits inside it
+static FilterBlock* blockFor(const IsbnFilter *filter, uint64_t hash){
+    return &filter->blocks[hash >> filter->block_shift];
+}
+
+static void setBits(IsbnFilter *filter, long isbn){
+    uint64_t hash = filterHash(isbn);
+    FilterBlock *block = blockFor(filter, hash);
+    unsigned bit = (unsigned)hash & 511, step = ((unsigned)(hash >> 9) & 511) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++, bit = (bit + step) & 511){
+        block->words[bit >> 6] |= 1ull << (bit & 63);
+    }
+    filter->keys++;
+}
+
+static int testBits(const IsbnFilter *filter, long isbn){
+    uint64_t hash = filterHash(isbn);
+    const FilterBlock *block = blockFor(filter, hash);
+    unsigned bit = (unsigned)hash & 511, step = ((unsigned)(hash >> 9) & 511) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++, bit = (bit + step) & 511){
+        if (!(block->words[bit >> 6] & (1ull << (bit & 63)))) return 0;
+    }
+    return 1;
+}
+
+static size_t capacityOf(const IsbnFilter *filter){
+    return filter->block_count * FILTER_BLOCK_WORDS * 64 / FILTER_BITS_PER_KEY;
+}
+
+// Fresh bits for every ISBN in the index, in the fewest blocks that hold
+// them; on failure the filter passes every check through until the next rebuild
+static void rebuild(IsbnFilter *filter, const IsbnIndex *index){
+    size_t blocks = FILTER_MIN_BLOCKS;
+    while (blocks * FILTER_BLOCK_WORDS * 64 / FILTER_BITS_PER_KEY < index->count) blocks *= 2;
+    if (blocks != filter->block_count || !filter->blocks){
+        free(filter->blocks);
+        filter->blocks = aligned_alloc(sizeof(FilterBlock), blocks * sizeof(FilterBlock));
+        filter->block_count = filter->blocks ? blocks : 0;
+        if (!filter->blocks) return;
+        STATS_BYTES(blocks * sizeof(FilterBlock));
+    }
+    memset(filter->blocks, 0, blocks * sizeof(FilterBlock));
+    filter->block_shift = 64 - __builtin_ctzll(blocks);
+    filter->keys = 0;
+    filter->stale = 0;
+    filter->rebuilds++;
+    for (size_t i = 0; i < index->capacity; i++){
+        if (index->slots[i].book) setBits(filter, index->slots[i].isbn);
+    }
+}
+
+// ============= HOOKS =============
+
+int isbnFilterMayContain(IsbnFilter *filter, long isbn){
+    if (!filter->blocks) return 1;
+    FilterCounters *c = stripe(filter);
+    atomic_fetch_add_explicit(&c->checks, 1, memory_order_relaxed);
+    if (testBits(filter, isbn)) return 1;
+    atomic_fetch_add_explicit(&c->skipped, 1, memory_order_relaxed);
+    return 0;
+}
+
+void isbnFilterMissed(IsbnFilter *filter){
+    if (filter->blocks) atomic_fetch_add_explicit(&stripe(filter)->false_positives, 1, memory_order_relaxed);
+}
+
+// The index already holds isbn, so a rebuild picks it up
+void isbnFilterAdd(IsbnFilter *filter, const IsbnIndex *index, long isbn){
+    if (!filter->blocks || filter->keys + 1 > capacityOf(filter)) rebuild(filter, index);
+    else setBits(filter, isbn);
+}
+
+// Stale ISBNs still pass, so once they are a fifth of the filter it is
+// rebuilt. A rebuild reads every index slot, and the index never shrinks, so
+// it also waits for a sixteenth of the slots' worth of deletes; emptying a
+// library then costs a few rebuilds, not one per fifth.
+void isbnFilterRemove(IsbnFilter *filter, const IsbnIndex *index){
+    filter->stale++;
+    if (filter->stale * 5 > filter->keys && filter->stale * 16 >= index->capacity) rebuild(filter, index);
+}
+
+void isbnFilterReset(IsbnFilter *filter, const IsbnIndex *index){
+    if (filter) rebuild(filter, index);
+}
+
+void destroyIsbnFilter(IsbnFilter *filter){
+    if (!filter) return;
+    free(filter->blocks);
+    free(filter);
+}
+
+// ============= SETUP AND REPORTING =============
+
+int setIsbnFilter(Library *lib, int enabled){
+    destroyIsbnFilter(lib->filter);
+    lib->filter = NULL;
+    if (!enabled) return 1;
+
+    IsbnFilter *filter = aligned_alloc(sizeof(FilterCounters), sizeof(IsbnFilter));
+    if (!filter) return 0;
+    memset(filter, 0, sizeof(*filter));
+    rebuild(filter, &lib->index);
+    if (!filter->blocks){
+        free(filter);
+        return 0;
+    }
+    filter->rebuilds = 0;
+    lib->filter = filter;
+    return 1;
+}
+
+int isbnFilterEnabled(const Library *lib){
+    return lib->filter != NULL;
+}
+
+void readIsbnFilterStats(const Library *lib, IsbnFilterStats *stats){
+    *stats = (IsbnFilterStats){0};
+    IsbnFilter *filter = lib->filter;
+    if (!filter) return;
+
+    stats->bytes = filter->block_count * sizeof(FilterBlock);
+    stats->keys = filter->keys;
+    stats->stale = filter->stale;
+    stats->rebuilds = filter->rebuilds;
+    for (int i = 0; i < FILTER_STRIPES; i++){
+        FilterCounters *c = &filter->counters[i];
+        stats->checks += atomic_load_explicit(&c->checks, memory_order_relaxed);
+        stats->skipped += atomic_load_explicit(&c->skipped, memory_order_relaxed);
+        stats->false_positives += atomic_load_explicit(&c->false_positives, memory_order_relaxed);
+    }
+    uint64_t absent = stats->skipped + stats->false_positives;
+    stats->observed_fpr = absent ? (double)stats->false_positives / (double)absent : 0.0;
+
+    // An absent ISBN gets through when all its bits in its block happen to
+    // be set; blocks fill unevenly, so average over them
+    double fpr = 0.0;
+    for (size_t b = 0; b < filter->block_count; b++){
+        int set = 0;
+        for (int w = 0; w < FILTER_BLOCK_WORDS; w++) set += __builtin_popcountll(filter->blocks[b].words[w]);
+        double fill = (double)set / (FILTER_BLOCK_WORDS * 64), p = 1.0;
+        for (int i = 0; i < FILTER_HASHES; i++) p *= fill;
+        fpr += p;
+    }
+    stats->expected_fpr = filter->block_count ? fpr / (double)filter->block_count : 0.0;
+}
@@ -0,0 +1,49 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "book.h"
+
+// Optional Bloom filter in front of the ISBN index. Every lookup by ISBN
+// (addBook's duplicate check, bulk loads, findBook, lookupBook, deletes)
+// asks it first, and an ISBN it has never seen is answered without probing
+// the index. Each ISBN sets its bits in one 64-byte block, so a check reads
+// one cache line of a table a tenth the size of the index or less.
+//
+// Once enabled it is kept up to date by book.c. Bits cannot be cleared, so a
+// deleted ISBN only counts as stale; the filter is rebuilt from the index
+// when it fills up or once a fifth of what it holds is stale. It never
+// answers "absent" for a book in the library.
+typedef struct IsbnFilter IsbnFilter;
+
+typedef struct{
+    size_t bytes;
+    size_t keys;              // ISBNs set since the last rebuild, stale ones included
+    size_t stale;             // deleted since the last rebuild
+    size_t rebuilds;
+    uint64_t checks;          // lookups the filter answered
+    uint64_t skipped;         // definite misses, the index was not probed
+    uint64_t false_positives; // passed the filter but were not in the index
+    double expected_fpr;      // from the share of bits set
+    double observed_fpr;      // false_positives / (skipped + false_positives)
+}IsbnFilterStats;
+
+// Builds the filter from the library's current books, or drops it. Returns 0
+// only when memory runs out, leaving the filter off.
+int setIsbnFilter(Library *lib, int enabled);
+int isbnFilterEnabled(const Library *lib);
+void readIsbnFilterStats(const Library *lib, IsbnFilterStats *stats);  // all zero when off
+
+// Lookup hooks called by book.c; the counters are striped per thread, so
+// readers sharing a library do not contend on them
+int isbnFilterMayContain(IsbnFilter *filter, long isbn);  // 0: definitely absent
+void isbnFilterMissed(IsbnFilter *filter);                 // a "maybe" the index did not have
+
+// Mutation hooks called by book.c, after the index has been updated
+void isbnFilterAdd(IsbnFilter *filter, const IsbnIndex *index, long isbn);
+void isbnFilterRemove(IsbnFilter *filter, const IsbnIndex *index);
+void isbnFilterReset(IsbnFilter *filter, const IsbnIndex *index);  // contents replaced wholesale
+void destroyIsbnFilter(IsbnFilter *filter);
+
+#endif // FILTER_H
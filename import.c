@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "import.h"
+#include "cli_utils.h"
+
+#define IMPORT_BUFFER     (1 << 20)  // also the longest accepted line or CSV record
+#define IMPORT_MAXNUM     32
+#define IMPORT_MAX_REPORT 10         // rejected rows reported individually
+
+// ============= FIELD HELPERS =============
+
+static int parseIsbn(const char *text, long *isbn){
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (end == text || *end || errno == ERANGE) return 0;
+    *isbn = value;
+    return 1;
+}
+
+// Same acceptance rule as getRating
+static int parseRating(const char *text, float *rating){
+    char *end;
+    float value = strtof(text, &end);
+    while (*end == ' ' || *end == '\t') end++;
+    if (end == text || *end || !(value >= 0.0f && value <= 5.0f)) return 0;
+    *rating = value;
+    return 1;
+}
+
+// ============= CSV =============
+
+// Unquotes one field in place, NUL-terminating it where the decoded text ends
+// (at the latest on its delimiter), and returns the position of the delimiter
+// (or end); NULL on broken quoting
+static char* csvField(char *p, const char *end, const char **field){
+    char *dst = p;
+    *field = dst;
+    if (p < end && *p == '"'){
+        p++;
+        while (1){
+            if (p >= end) return NULL;
+            if (*p == '"'){
+                if (p + 1 < end && p[1] == '"'){
+                    p++;
+                }
+                else{
+                    p++;
+                    break;
+                }
+            }
+            *dst++ = *p++;
+        }
+        if (p < end && *p != ',') return NULL;
+    }
+    else{
+        while (p < end && *p != ',') p++;
+        dst = p;
+    }
+    *dst = '\0';
+    return p;
+}
+
+// End of the CSV record starting at p: its first newline outside a quoted
+// field, or NULL when [p, end) does not hold one yet. As in csvField, a field
+// is quoted only when it starts with '"'; a quote anywhere else is plain text.
+// *lines counts the newlines inside quoted fields.
+static char* csvRecordEnd(char *p, char *end, size_t *lines){
+    *lines = 0;
+    char *nl = memchr(p, '\n', (size_t)(end - p));
+    if (nl && !memchr(p, '"', (size_t)(nl - p))) return nl;  // no quotes at all, the usual case
+
+    int field_start = 1;
+    while (p < end){
+        if (field_start && *p == '"'){
+            // Runs to a quote that is not doubled, newlines included
+            for (p++; ; p++){
+                if (p == end) return NULL;
+                if (*p == '\n') (*lines)++;
+                else if (*p == '"'){
+                    if (p + 1 == end) return NULL;  // doubled or closing: not known yet
+                    if (p[1] != '"') break;
+                    p++;
+                }
+            }
+            p++;
+            field_start = 0;
+            continue;
+        }
+        if (*p == '\n') return p;
+        field_start = *p == ',';
+        p++;
+    }
+    return NULL;
+}
+
+const char* parseCsvRow(char *p, const char *end, ImportRow *row){
+    const char *isbn, *rating;
+    const char **fields[4] = {&row->title, &row->author, &isbn, &rating};
+
+    for (int i = 0; i < 4; i++){
+        p = csvField(p, end, fields[i]);
+        if (!p) return "unterminated quoted field";
+        if (i < 3){
+            if (p == end) return "expected 4 fields";
+            p++;
+        }
+    }
+    if (p != end) return "expected 4 fields";
+
+    if (!parseIsbn(isbn, &row->isbn)) return "invalid ISBN";
+    if (!parseRating(rating, &row->rating)) return "invalid rating (0.0-5.0)";
+    return NULL;
+}
+
+// ============= JSON LINES =============
+
+static char* skipSpace(char *p, const char *end){
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static int hexValue(char c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static char* putUtf8(char *dst, unsigned cp){
+    char enc[4];
+    size_t len;
+    if (cp < 0x80){
+        enc[0] = (char)cp;
+        len = 1;
+    }
+    else if (cp < 0x800){
+        enc[0] = (char)(0xC0 | (cp >> 6));
+        enc[1] = (char)(0x80 | (cp & 0x3F));
+        len = 2;
+    }
+    else if (cp < 0x10000){
+        enc[0] = (char)(0xE0 | (cp >> 12));
+        enc[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[2] = (char)(0x80 | (cp & 0x3F));
+        len = 3;
+    }
+    else{
+        enc[0] = (char)(0xF0 | (cp >> 18));
+        enc[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        enc[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[3] = (char)(0x80 | (cp & 0x3F));
+        len = 4;
+    }
+    memcpy(dst, enc, len);
+    return dst + len;
+}
+
+static char* parseHex4(char *p, const char *end, unsigned *out){
+    if (end - p < 4) return NULL;
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++){
+        int digit = hexValue(p[i]);
+        if (digit < 0) return NULL;
+        value = value << 4 | (unsigned)digit;
+    }
+    *out = value;
+    return p + 4;
+}
+
+// p points at the opening quote; decodes the string in place (escapes never
+// grow, so the text ends before the closing quote) and returns the position
+// after the closing quote
+static char* jsonString(char *p, const char *end, const char **out){
+    char *dst = p;
+    *out = dst;
+    p++;
+    while (p < end && *p != '"'){
+        if (*p != '\\'){
+            *dst++ = *p++;
+            continue;
+        }
+        if (++p >= end) return NULL;
+        unsigned cp;
+        switch (*p++){
+            case '"':  cp = '"'; break;
+            case '\\': cp = '\\'; break;
+            case '/':  cp = '/'; break;
+            case 'b':  cp = '\b'; break;
+            case 'f':  cp = '\f'; break;
+            case 'n':  cp = '\n'; break;
+            case 'r':  cp = '\r'; break;
+            case 't':  cp = '\t'; break;
+            case 'u':
+                if (!(p = parseHex4(p, end, &cp))) return NULL;
+                if (cp >= 0xD800 && cp < 0xDC00){
+                    unsigned low;
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u') return NULL;
+                    if (!(p = parseHex4(p + 2, end, &low)) || low < 0xDC00 || low > 0xDFFF) return NULL;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                break;
+            default:
+                return NULL;
+        }
+        dst = putUtf8(dst, cp);
+    }
+    if (p >= end) return NULL;
+    *dst = '\0';
+    return p + 1;
+}
+
+// Returns NULL on success or the reason the row was rejected
+static const char* parseJsonRow(char *p, const char *end, ImportRow *row){
+    char number[IMPORT_MAXNUM];
+    const char *key, *value;
+    int seen = 0;  // bit per required key: title, author, isbn, rating
+
+    p = skipSpace(p, end);
+    if (p == end || *p != '{') return "expected a JSON object";
+    p = skipSpace(p + 1, end);
+
+    while (p < end && *p != '}'){
+        if (*p != '"' || !(p = jsonString(p, end, &key))) return "malformed key";
+        p = skipSpace(p, end);
+        if (p == end || *p != ':') return "expected ':'";
+        p = skipSpace(p + 1, end);
+
+        int field = strcmp(key, "title") == 0 ? 0 : strcmp(key, "author") == 0 ? 1 :
+                    strcmp(key, "isbn") == 0 ? 2 : strcmp(key, "rating") == 0 ? 3 : -1;
+
+        if (p < end && *p == '"'){
+            if (!(p = jsonString(p, end, &value))) return "malformed string";
+        }
+        else{
+            // Bare values are copied out: their delimiter is still to be parsed
+            size_t n = 0;
+            while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t'){
+                if (n < sizeof(number) - 1) number[n++] = *p;
+                p++;
+            }
+            if (!n) return "missing value";
+            number[n] = '\0';
+            value = number;
+            if (field == 0 || field == 1) return "title and author must be strings";
+        }
+
+        if (field == 0) row->title = value;
+        if (field == 1) row->author = value;
+
+        if (field == 2 && !parseIsbn(value, &row->isbn)) return "invalid ISBN";
+        if (field == 3 && !parseRating(value, &row->rating)) return "invalid rating (0.0-5.0)";
+        if (field >= 0) seen |= 1 << field;
+
+        p = skipSpace(p, end);
+        if (p < end && *p == ','){
+            p = skipSpace(p + 1, end);
+            if (p < end && *p == '}') return "trailing ','";
+        }
+        else if (p == end || *p != '}'){
+            return "expected ',' or '}'";
+        }
+    }
+    if (p == end) return "unterminated object";
+    if (skipSpace(p + 1, end) != end) return "trailing characters after object";
+    if (seen != 0xF) return "missing title, author, isbn or rating";
+    return NULL;
+}
+
+// ============= STREAMING DRIVER =============
+
+typedef struct{
+    Library *lib;
+    ImportStats *stats;
+    int json;
+    int header_checked;
+    size_t line_no;
+}ImportState;
+
+static void rejectRow(ImportState *st, const char *reason){
+    st->stats->rejected++;
+    if (st->stats->rejected <= IMPORT_MAX_REPORT){
+        printWarning("Line %zu rejected: %s", st->line_no, reason);
+    }
+}
+
+// [p, end) is writable and end may be overwritten: fields are decoded in place
+static void importLine(ImportState *st, char *p, char *end){
+    st->line_no++;
+    if (end > p && end[-1] == '\r') end--;
+    if (skipSpace(p, end) == end) return;
+
+    ImportRow row;
+    row.title = "";
+    const char *err = st->json ? parseJsonRow(p, end, &row) : parseCsvRow(p, end, &row);
+
+    // A leading "title,..." row is a CSV header, not a rejected record
+    if (!st->header_checked){
+        st->header_checked = 1;
+        if (!st->json && err && strcasecmp(row.title, "title") == 0) return;
+    }
+
+    st->stats->rows++;
+    if (err){
+        rejectRow(st, err);
+        return;
+    }
+
+    Book *book = loadBook(st->lib, listForRating(st->lib, row.rating), row.title, row.author, row.isbn, row.rating);
+    if (!book){
+        rejectRow(st, "duplicate ISBN or out of memory");
+        return;
+    }
+    st->lib->last_added = book;
+    st->stats->imported++;
+}
+
+static double monotonicSeconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int importBooks(Library *lib, const char *path, ImportStats *stats){
+    memset(stats, 0, sizeof(*stats));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        printError("Cannot open import file.");
+        return 0;
+    }
+
+    // One buffer for the whole run; rows are decoded in place, and the spare
+    // byte lets a final line without a newline be terminated too
+    char *buf = malloc(IMPORT_BUFFER + 1);
+    if (!buf){
+        close(fd);
+        printError("Memory allocation failed!");
+        return 0;
+    }
+
+    double start = monotonicSeconds();
+    ImportState st = {lib, stats, -1, 0, 0};
+    size_t have = 0;
+    int eof = 0, skipping = 0, ok = 1;
+
+    while (!eof){
+        ssize_t got = read(fd, buf + have, IMPORT_BUFFER - have);
+        if (got < 0){
+            if (errno == EINTR) continue;
+            printError("Read error while importing.");
+            ok = 0;
+            break;
+        }
+        eof = got == 0;
+        have += (size_t)got;
+
+        char *p = buf, *end = buf + have;
+        if (st.json < 0){
+            const char *first = p;
+            while (first < end && (*first == ' ' || *first == '\t' || *first == '\r' || *first == '\n')) first++;
+            if (first == end && !eof && have < IMPORT_BUFFER) continue;
+            st.json = first < end && *first == '{';
+        }
+
+        while (p < end){
+            // A quoted CSV field may hold newlines; the tail of an overlong
+            // record is skipped to the next newline whatever its quoting
+            size_t lines = 0;
+            char *nl = st.json || skipping ? memchr(p, '\n', (size_t)(end - p)) : csvRecordEnd(p, end, &lines);
+            if (!nl){
+                if (!eof) break;
+                nl = end;
+            }
+            if (skipping){
+                skipping = 0;  // tail of an overlong line, already rejected
+            }
+            else{
+                importLine(&st, p, nl);
+                st.line_no += lines;
+            }
+            p = nl < end ? nl + 1 : end;
+        }
+
+        have = (size_t)(end - p);
+        if (have == IMPORT_BUFFER){
+            // No newline in a full buffer: reject the line and drop it as it streams past
+            if (!skipping){
+                st.line_no++;
+                stats->rows++;
+                rejectRow(&st, "line too long");
+            }
+            skipping = 1;
+            have = 0;
+        }
+        else if (have){
+            memmove(buf, p, have);
+        }
+    }
+
+    free(buf);
+    close(fd);
+    stats->seconds = monotonicSeconds() - start;
+    return ok;
+}
@@ -0,0 +1,32 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <stddef.h>
+#include "book.h"
+
+// One decoded input row; the strings point into the parsed line
+typedef struct{
+    const char *title;
+    const char *author;
+    long isbn;
+    float rating;
+}ImportRow;
+
+// Summary of one bulk import run
+typedef struct{
+    size_t rows;       // data rows seen, header and blank lines excluded
+    size_t imported;
+    size_t rejected;   // malformed, out-of-range rating or duplicate ISBN
+    double seconds;
+}ImportStats;
+
+// Streams a CSV (title,author,isbn,rating) or JSON Lines file into main_list,
+// or into the rating buckets while split. Returns 1 if the file was read to
+// the end, 0 on I/O errors.
+int importBooks(Library *lib, const char *path, ImportStats *stats);
+
+// Decodes one CSV record from [p, end) in place, writing at most up to *end;
+// NULL on success, else why it was rejected
+const char* parseCsvRow(char *p, const char *end, ImportRow *row);
+
+#endif // IMPORT_H
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "snapshot.h"
+#include "cli_utils.h"
+
+// File layout: "BKJL" + u32 version, then records of
+//   u32 body length | u32 CRC-32 of body | body
+// where body = u64 lsn | u8 op | u8 list | op payload.
+// A short or corrupt tail is a torn write from a crash and is cut off on open.
+#define JOURNAL_MAGIC      "BKJL"
+#define JOURNAL_VERSION    2  // v2 ADD records carry u32 lengths and NUL-terminated strings
+#define JOURNAL_HEADER     8
+#define JOURNAL_FRAME      8
+#define JOURNAL_BODY       10  // lsn, op and list ahead of the payload
+#define JOURNAL_BUFFER     (1 << 16)
+#define JOURNAL_MAXPATH    4096
+#define JOURNAL_V1_MAXNAME 100
+
+struct Journal{
+    int fd;
+    char snapshot_path[JOURNAL_MAXPATH];
+    JournalConfig config;
+    unsigned char *buf;       // grows past JOURNAL_BUFFER only for oversized records
+    size_t capacity;
+    size_t used;              // encoded bytes not yet written
+    unsigned pending;         // records not yet fsynced
+    uint64_t next_lsn;
+    struct timespec last_sync;
+    int failed;               // set after an I/O error so it is reported once
+};
+
+// ============= ENCODING =============
+
+static uint32_t crcTable[256];
+
+static void initCrcTable(void){
+    if (crcTable[1]) return;
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[i] = c;
+    }
+}
+
+static uint32_t crc32(const unsigned char *data, size_t len){
+    uint32_t c = 0xFFFFFFFFu;
+    while (len--) c = crcTable[(c ^ *data++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static unsigned char* put(unsigned char *p, const void *value, size_t size){
+    memcpy(p, value, size);
+    return p + size;
+}
+
+static const unsigned char* get(const unsigned char *p, void *value, size_t size){
+    memcpy(value, p, size);
+    return p + size;
+}
+
+// ============= WRITING =============
+
+static double elapsedMs(const struct timespec *since){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) * 1e3 + (double)(now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+static void journalFailed(Journal *journal){
+    if (!journal->failed) printError("Journal write failed: %s", strerror(errno));
+    journal->failed = 1;
+}
+
+static int writeBuffered(Journal *journal){
+    size_t done = 0;
+    while (done < journal->used){
+        ssize_t n = write(journal->fd, journal->buf + done, journal->used - done);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            journalFailed(journal);
+            journal->used = 0;  // drop what cannot be written rather than overflow
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    journal->used = 0;
+    return 1;
+}
+
+int syncJournal(Journal *journal){
+    if (!journal) return 1;
+    if (!writeBuffered(journal)) return 0;
+    if (journal->pending && fdatasync(journal->fd) != 0){
+        journalFailed(journal);
+        return 0;
+    }
+    journal->pending = 0;
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+    return 1;
+}
+
+int syncJournalIfDue(Journal *journal){
+    if (!journal || !journal->pending) return 1;
+    if (journal->pending >= journal->config.sync_every ||
+        elapsedMs(&journal->last_sync) >= journal->config.sync_interval_ms){
+        return syncJournal(journal);
+    }
+    return 1;
+}
+
+// Makes room for a record with len payload bytes, writes its body header and
+// returns where the payload goes; NULL if the buffer cannot grow
+static unsigned char* beginRecord(Journal *journal, JournalOp op, char list, size_t len){
+    size_t need = JOURNAL_FRAME + JOURNAL_BODY + len;
+    if (journal->used + need > journal->capacity) writeBuffered(journal);
+    if (need > journal->capacity){
+        unsigned char *buf = realloc(journal->buf, need);
+        if (!buf){
+            errno = ENOMEM;
+            journalFailed(journal);
+            return NULL;
+        }
+        journal->buf = buf;
+        journal->capacity = need;
+    }
+
+    unsigned char *p = journal->buf + journal->used + JOURNAL_FRAME;
+    uint64_t lsn = journal->next_lsn++;
+    uint8_t code = (uint8_t)op, list_byte = (uint8_t)list;
+    p = put(p, &lsn, sizeof(lsn));
+    p = put(p, &code, 1);
+    return put(p, &list_byte, 1);
+}
+
+// Frames the record ending at end and applies the commit policy
+static void commitRecord(Journal *journal, const unsigned char *end){
+    unsigned char *frame = journal->buf + journal->used;
+    unsigned char *body = frame + JOURNAL_FRAME;
+    uint32_t body_len = (uint32_t)(end - body);
+    uint32_t crc = crc32(body, body_len);
+    put(put(frame, &body_len, 4), &crc, 4);
+
+    journal->used += JOURNAL_FRAME + body_len;
+    journal->pending++;
+    syncJournalIfDue(journal);
+}
+
+// Strings keep their terminators so replay can hand them over without copying
+void journalLogAdd(Journal *journal, char list, long isbn, float rating, const char *title, const char *author){
+    int64_t value = isbn;
+    uint32_t title_len = (uint32_t)strlen(title);
+    uint32_t author_len = (uint32_t)strlen(author);
+
+    unsigned char *p = beginRecord(journal, JOURNAL_ADD, list, 20 + (size_t)title_len + author_len + 2);
+    if (!p) return;
+    p = put(p, &value, sizeof(value));
+    p = put(p, &rating, sizeof(rating));
+    p = put(p, &title_len, sizeof(title_len));
+    p = put(p, &author_len, sizeof(author_len));
+    p = put(p, title, title_len + 1);
+    p = put(p, author, author_len + 1);
+    commitRecord(journal, p);
+}
+
+void journalLogDelete(Journal *journal, char list, long isbn){
+    int64_t value = isbn;
+    unsigned char *p = beginRecord(journal, JOURNAL_DELETE, list, sizeof(value));
+    if (p) commitRecord(journal, put(p, &value, sizeof(value)));
+}
+
+void journalLogOp(Journal *journal, JournalOp op, char list){
+    unsigned char *p = beginRecord(journal, op, list, 0);
+    if (p) commitRecord(journal, p);
+}
+
+void journalLogBuckets(Journal *journal, const float *cuts, int count){
+    unsigned char *p = beginRecord(journal, JOURNAL_BUCKETS, 'm', (size_t)count * sizeof(float));
+    if (p) commitRecord(journal, put(p, cuts, (size_t)count * sizeof(float)));
+}
+
+// ============= REPLAY =============
+
+// v1 ADD payload: u16 lengths and unterminated strings of under 100 bytes
+static int replayAddV1(Library *lib, char list, const unsigned char *p, size_t rest){
+    int64_t isbn;
+    float rating;
+    uint16_t title_len, author_len;
+    char title[JOURNAL_V1_MAXNAME], author[JOURNAL_V1_MAXNAME];
+    if (rest < 16) return 0;
+    p = get(p, &isbn, sizeof(isbn));
+    p = get(p, &rating, sizeof(rating));
+    p = get(p, &title_len, sizeof(title_len));
+    p = get(p, &author_len, sizeof(author_len));
+    if (title_len >= JOURNAL_V1_MAXNAME || author_len >= JOURNAL_V1_MAXNAME || rest != 16u + title_len + author_len){
+        return 0;
+    }
+    memcpy(title, p, title_len);
+    title[title_len] = '\0';
+    memcpy(author, p + title_len, author_len);
+    author[author_len] = '\0';
+    Book *book = loadBook(lib, list, title, author, (long)isbn, rating);
+    if (book) lib->last_added = book;
+    return 1;
+}
+
+// Applies one record body; returns 0 if the body is malformed
+static int replayRecord(Library *lib, uint32_t version, const unsigned char *body, size_t len){
+    if (len < JOURNAL_BODY) return 0;
+    uint64_t lsn;
+    const unsigned char *p = get(body, &lsn, sizeof(lsn));
+    JournalOp op = (JournalOp)p[0];
+    char list = (char)p[1];
+    p += 2;
+    size_t rest = len - JOURNAL_BODY;
+
+    // Records already folded into the snapshot are skipped
+    if (lsn <= lib->journal_lsn) return 1;
+    lib->journal_lsn = lsn;
+
+    switch (op){
+        case JOURNAL_ADD:{
+            if (version == 1) return replayAddV1(lib, list, p, rest);
+            int64_t isbn;
+            float rating;
+            uint32_t title_len, author_len;
+            if (rest < 22) return 0;
+            p = get(p, &isbn, sizeof(isbn));
+            p = get(p, &rating, sizeof(rating));
+            p = get(p, &title_len, sizeof(title_len));
+            p = get(p, &author_len, sizeof(author_len));
+            if ((uint64_t)title_len + author_len + 22 != rest || p[title_len] || p[title_len + 1 + author_len]){
+                return 0;
+            }
+            const char *title = (const char *)p;
+            Book *book = loadBook(lib, list, title, title + title_len + 1, (long)isbn, rating);
+            if (book) lib->last_added = book;
+            return 1;
+        }
+        case JOURNAL_DELETE:{
+            int64_t isbn;
+            if (rest != sizeof(isbn)) return 0;
+            get(p, &isbn, sizeof(isbn));
+            deleteBookByISBN(lib, list, (long)isbn);
+            return 1;
+        }
+        case JOURNAL_DELETE_LAST: deleteLastAddedBook(lib); return 1;
+        case JOURNAL_SPLIT:       splitLibrary(lib); return 1;
+        case JOURNAL_MERGE:       mergeLibrary(lib); return 1;
+        case JOURNAL_SORT:        sortByRating(lib, list); return 1;
+        case JOURNAL_FREE:        freeLibraryList(lib, list); return 1;
+        case JOURNAL_UNDO:        undoLastChange(lib); return 1;
+        case JOURNAL_BUCKETS:{
+            float cuts[MAX_BUCKETS - 1];
+            if (rest % sizeof(float) || rest > sizeof(cuts)) return 0;
+            memcpy(cuts, p, rest);
+            setRatingBuckets(lib, cuts, (int)(rest / sizeof(float)));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Replays every intact record and returns the offset just past the last one
+static size_t replayJournal(Library *lib, uint32_t version, const unsigned char *data, size_t size,
+                            uint64_t *last_lsn){
+    size_t pos = JOURNAL_HEADER;
+    while (size - pos >= JOURNAL_FRAME){
+        uint32_t body_len, crc;
+        get(get(data + pos, &body_len, 4), &crc, 4);
+        if (body_len > size - pos - JOURNAL_FRAME) break;
+
+        const unsigned char *body = data + pos + JOURNAL_FRAME;
+        if (crc32(body, body_len) != crc || !replayRecord(lib, version, body, body_len)) break;
+
+        uint64_t lsn;
+        get(body, &lsn, sizeof(lsn));
+        if (lsn > *last_lsn) *last_lsn = lsn;
+        pos += JOURNAL_FRAME + body_len;
+    }
+    return pos;
+}
+
+// Empties the file down to a current-version header, positioned for appending
+static int resetJournalFile(int fd){
+    unsigned char header[JOURNAL_HEADER];
+    uint32_t version = JOURNAL_VERSION;
+    memcpy(header, JOURNAL_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    return ftruncate(fd, 0) == 0 && pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+           lseek(fd, JOURNAL_HEADER, SEEK_SET) >= 0 && fsync(fd) == 0;
+}
+
+// Opens (creating if needed) and replays the journal file; returns the fd
+// positioned for appending, or -1. *version is the file's format version.
+static int replayJournalFile(Library *lib, const char *path, uint64_t *last_lsn, uint32_t *version){
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0){
+        printError("Cannot open journal file.");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        close(fd);
+        printError("Cannot open journal file.");
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size, keep = JOURNAL_HEADER;
+    *version = JOURNAL_VERSION;
+    if (size < JOURNAL_HEADER){
+        // New (or torn before its header was complete): start a fresh file
+        if (!resetJournalFile(fd)){
+            close(fd);
+            printError("Cannot initialise journal file.");
+            return -1;
+        }
+    }
+    else{
+        unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            close(fd);
+            printError("Cannot map journal file.");
+            return -1;
+        }
+        memcpy(version, data + 4, 4);
+        if (memcmp(data, JOURNAL_MAGIC, 4) != 0 || *version < 1 || *version > JOURNAL_VERSION){
+            munmap(data, size);
+            close(fd);
+            printError("Not a supported book library journal.");
+            return -1;
+        }
+        keep = replayJournal(lib, *version, data, size, last_lsn);
+        munmap(data, size);
+
+        if (keep < size){
+            printWarning("Journal had a torn tail; discarded %zu bytes.", size - keep);
+            if (ftruncate(fd, (off_t)keep) != 0 || fsync(fd) != 0){
+                close(fd);
+                printError("Cannot repair journal file.");
+                return -1;
+            }
+        }
+    }
+
+    if (lseek(fd, (off_t)keep, SEEK_SET) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ============= LIFECYCLE =============
+
+int openJournal(Library *lib, const char *base, const JournalConfig *config){
+    initCrcTable();
+    if (lib->journal){
+        printError("A journal is already attached.");
+        return 0;
+    }
+
+    Journal *journal = malloc(sizeof(Journal));
+    if (!journal){
+        printError("Memory allocation failed!");
+        return 0;
+    }
+    char journal_path[JOURNAL_MAXPATH];
+    if (snprintf(journal->snapshot_path, JOURNAL_MAXPATH, "%s.snap", base) >= JOURNAL_MAXPATH ||
+        snprintf(journal_path, JOURNAL_MAXPATH, "%s.journal", base) >= JOURNAL_MAXPATH){
+        free(journal);
+        printError("Store path is too long.");
+        return 0;
+    }
+
+    if (access(journal->snapshot_path, F_OK) == 0 && !loadSnapshot(lib, journal->snapshot_path)){
+        free(journal);
+        return 0;
+    }
+
+    // Replay through the normal operations, muted and without re-journaling
+    uint64_t last_lsn = lib->journal_lsn;
+    uint32_t version = JOURNAL_VERSION;
+    int messages = messagesEnabled();
+    setMessagesEnabled(0);
+    journal->fd = replayJournalFile(lib, journal_path, &last_lsn, &version);
+    setMessagesEnabled(messages);
+    if (journal->fd < 0){
+        free(journal);
+        return 0;
+    }
+
+    journal->buf = malloc(JOURNAL_BUFFER);
+    if (!journal->buf){
+        close(journal->fd);
+        free(journal);
+        printError("Memory allocation failed!");
+        return 0;
+    }
+    journal->capacity = JOURNAL_BUFFER;
+    journal->config = *config;
+    journal->used = 0;
+    journal->pending = 0;
+    journal->next_lsn = (last_lsn > lib->journal_lsn ? last_lsn : lib->journal_lsn) + 1;
+    journal->failed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+    lib->journal = journal;
+
+    // Records are never appended behind an older header: fold them in first
+    if (version != JOURNAL_VERSION) return compactJournal(lib);
+    return 1;
+}
+
+void closeJournal(Library *lib){
+    Journal *journal = lib->journal;
+    if (!journal) return;
+    syncJournal(journal);
+    close(journal->fd);
+    free(journal->buf);
+    free(journal);
+    lib->journal = NULL;
+}
+
+int compactJournal(Library *lib){
+    Journal *journal = lib->journal;
+    if (!journal){
+        printError("No journal is attached.");
+        return 0;
+    }
+    if (!syncJournal(journal)) return 0;
+
+    // The snapshot records the last folded LSN, so if a crash lands between the
+    // rename and the truncate, replay skips the stale records instead of redoing them
+    lib->journal_lsn = journal->next_lsn - 1;
+    if (!saveSnapshot(lib, journal->snapshot_path)) return 0;
+    clearUndoLog(lib);  // replay starts from the snapshot with no history, so undo must too
+
+    if (!resetJournalFile(journal->fd)){
+        journalFailed(journal);
+        return 0;
+    }
+    return 1;
+}
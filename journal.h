@@ -0,0 +1,50 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "book.h"
+
+// Record types; the list byte of each record holds the getCurrentList choice
+typedef enum{
+    JOURNAL_ADD = 1,
+    JOURNAL_DELETE,
+    JOURNAL_DELETE_LAST,
+    JOURNAL_SPLIT,
+    JOURNAL_MERGE,
+    JOURNAL_SORT,
+    JOURNAL_FREE,
+    JOURNAL_BUCKETS,
+    JOURNAL_UNDO
+}JournalOp;
+
+// Group commit policy: buffered records are fsynced once sync_every records
+// are pending or sync_interval_ms has passed since the last fsync
+typedef struct{
+    unsigned sync_interval_ms;  // 0 syncs every record
+    unsigned sync_every;
+}JournalConfig;
+
+#define JOURNAL_DEFAULT_INTERVAL_MS 100
+#define JOURNAL_DEFAULT_SYNC_EVERY  1024
+
+typedef struct Journal Journal;
+
+// Durable store at <base>.snap + <base>.journal: loads the snapshot, replays
+// the journal on top of it and attaches the journal to lib. Returns 1 on success.
+int openJournal(Library *lib, const char *base, const JournalConfig *config);
+void closeJournal(Library *lib);
+
+// Writes the library to <base>.snap and empties the journal
+int compactJournal(Library *lib);
+
+// fsync everything appended so far, or only when the group commit policy says so
+int syncJournal(Journal *journal);
+int syncJournalIfDue(Journal *journal);
+
+// Mutation hooks called by book.c
+void journalLogAdd(Journal *journal, char list, long isbn, float rating, const char *title, const char *author);
+void journalLogDelete(Journal *journal, char list, long isbn);
+void journalLogOp(Journal *journal, JournalOp op, char list);
+void journalLogBuckets(Journal *journal, const float *cuts, int count);
+
+#endif // JOURNAL_H
@@ -0,0 +1,272 @@
+// Load generator for the --serve mode. Opens many connections, keeps a fixed
+// number of pipelined requests in flight on each and reports requests/sec and
+// latency percentiles. Replies are matched to requests by their terminating
+// "ok" / "err" line, which the protocol guarantees in order.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define LOADGEN_MAX_DEPTH   256
+#define LOADGEN_MAX_COMMAND 256
+#define LOADGEN_OUT_SIZE    4096
+#define LOADGEN_READ_SIZE   (64 * 1024)
+#define LOADGEN_HIST_US     1000000  // 1 us buckets up to 1 s, then one overflow bucket
+#define LOADGEN_MAX_EVENTS  256
+
+typedef struct{
+    const char *address;
+    int clients;
+    int depth;
+    double seconds;
+    const char *command;
+    long find_base;
+    long find_count;   // > 0: random "find <isbn>" in [base, base + count)
+}LoadOptions;
+
+typedef struct{
+    int fd;
+    uint64_t sent_at[LOADGEN_MAX_DEPTH];  // ring of send times, oldest first
+    int first;
+    int inflight;
+    char out[LOADGEN_OUT_SIZE];
+    int want_out;      // EPOLLOUT registered because a write came up short
+    size_t out_start;
+    size_t out_end;
+    char head[3];      // first bytes of the reply line being read
+    int head_len;
+}Connection;
+
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int connectTo(const char *address){
+    int fd;
+    if (strncmp(address, "unix:", 5) == 0){
+        struct sockaddr_un addr = {0};
+        if (strlen(address + 5) >= sizeof(addr.sun_path)) return -1;
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    else if (strncmp(address, "tcp:", 4) == 0){
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(address + 4));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    else{
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static unsigned nextRandom(unsigned *state){
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Tops the connection up to depth requests in flight
+static void queueRequests(Connection *c, const LoadOptions *opts, unsigned *seed){
+    while (c->inflight < opts->depth){
+        char *dst = c->out + c->out_end;
+        size_t room = sizeof(c->out) - c->out_end;
+        int len;
+        if (opts->find_count > 0){
+            len = snprintf(dst, room, "find %ld\n", opts->find_base + (long)(nextRandom(seed) % (unsigned long)opts->find_count));
+        }
+        else{
+            len = snprintf(dst, room, "%s\n", opts->command);
+        }
+        if (len < 0 || (size_t)len >= room) break;
+        c->out_end += (size_t)len;
+        c->sent_at[(c->first + c->inflight) % LOADGEN_MAX_DEPTH] = nowNs();
+        c->inflight++;
+    }
+}
+
+// 0 on a connection error
+static int sendQueued(Connection *c){
+    while (c->out_start < c->out_end){
+        ssize_t n = write(c->fd, c->out + c->out_start, c->out_end - c->out_start);
+        if (n < 0) return errno == EAGAIN || errno == EINTR;
+        c->out_start += (size_t)n;
+    }
+    c->out_start = c->out_end = 0;
+    return 1;
+}
+
+static int isReplyEnd(const Connection *c){
+    return (c->head_len >= 2 && c->head[0] == 'o' && c->head[1] == 'k') ||
+           (c->head_len == 3 && memcmp(c->head, "err", 3) == 0);
+}
+
+// Counts the replies completed in data and records their latencies
+static unsigned long long takeReplies(Connection *c, const char *data, size_t len, uint32_t *hist){
+    unsigned long long done = 0;
+    uint64_t now = nowNs();
+    for (size_t i = 0; i < len; i++){
+        if (data[i] != '\n'){
+            if (c->head_len < 3) c->head[c->head_len++] = data[i];
+            continue;
+        }
+        if (isReplyEnd(c) && c->inflight){
+            uint64_t us = (now - c->sent_at[c->first]) / 1000;
+            hist[us < LOADGEN_HIST_US ? us : LOADGEN_HIST_US]++;
+            c->first = (c->first + 1) % LOADGEN_MAX_DEPTH;
+            c->inflight--;
+            done++;
+        }
+        c->head_len = 0;
+    }
+    return done;
+}
+
+static double percentile(const uint32_t *hist, unsigned long long total, double p){
+    unsigned long long target = (unsigned long long)(p * (double)total), seen = 0;
+    for (size_t us = 0; us <= LOADGEN_HIST_US; us++){
+        seen += hist[us];
+        if (seen > target) return (double)us;
+    }
+    return (double)LOADGEN_HIST_US;
+}
+
+static int parseOptions(int argc, char *argv[], LoadOptions *opts){
+    opts->address = NULL;
+    opts->clients = 64;
+    opts->depth = 8;
+    opts->seconds = 5.0;
+    opts->command = "count";
+    opts->find_base = 0;
+    opts->find_count = 0;
+
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc) return 0;
+        if (strcmp(argv[i], "--connect") == 0) opts->address = argv[++i];
+        else if (strcmp(argv[i], "--clients") == 0) opts->clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0) opts->depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0) opts->seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--command") == 0) opts->command = argv[++i];
+        else if (strcmp(argv[i], "--find") == 0){
+            if (sscanf(argv[++i], "%ld:%ld", &opts->find_base, &opts->find_count) != 2) return 0;
+        }
+        else return 0;
+    }
+    return opts->address && opts->clients > 0 && opts->depth > 0 && opts->depth <= LOADGEN_MAX_DEPTH &&
+           opts->seconds > 0.0 && strlen(opts->command) < LOADGEN_MAX_COMMAND - 1 && opts->find_count >= 0;
+}
+
+int main(int argc, char *argv[]){
+    LoadOptions opts;
+    if (!parseOptions(argc, argv, &opts)){
+        fprintf(stderr, "Usage: %s --connect unix:path|tcp:port [--clients 64] [--depth 8] [--seconds 5]\n"
+                        "       [--command text | --find base:count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0){
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    Connection *conns = calloc((size_t)opts.clients, sizeof(Connection));
+    uint32_t *hist = calloc(LOADGEN_HIST_US + 1, sizeof(uint32_t));
+    char *buf = malloc(LOADGEN_READ_SIZE);
+    int epfd = epoll_create1(0);
+    if (!conns || !hist || !buf || epfd < 0){
+        fprintf(stderr, "Memory allocation failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned seed = 12345;
+    for (int i = 0; i < opts.clients; i++){
+        Connection *c = &conns[i];
+        c->fd = connectTo(opts.address);
+        if (c->fd < 0){
+            fprintf(stderr, "Cannot connect client %d to %s: %s\n", i, opts.address, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.ptr = c};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        c->want_out = 1;
+    }
+
+    unsigned long long completed = 0, errors = 0;
+    uint64_t start = nowNs(), stop = start + (uint64_t)(opts.seconds * 1e9);
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+    int open_conns = opts.clients;
+    while (open_conns && nowNs() < stop){
+        int n = epoll_wait(epfd, events, LOADGEN_MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++){
+            Connection *c = events[i].data.ptr;
+            if (events[i].events & EPOLLIN){
+                ssize_t got = read(c->fd, buf, LOADGEN_READ_SIZE);
+                if (got > 0) completed += takeReplies(c, buf, (size_t)got, hist);
+                else if (got == 0 || (errno != EAGAIN && errno != EINTR)) events[i].events = EPOLLERR;
+            }
+            if (!(events[i].events & (EPOLLERR | EPOLLHUP))){
+                if (c->out_start == c->out_end) queueRequests(c, &opts, &seed);
+                if (sendQueued(c)){
+                    // Only wait for writability while a write is outstanding
+                    int want_out = c->out_start != c->out_end;
+                    if (want_out != c->want_out){
+                        struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0), .data.ptr = c};
+                        epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                        c->want_out = want_out;
+                    }
+                    continue;
+                }
+            }
+            epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+            close(c->fd);
+            c->fd = -1;
+            open_conns--;
+            errors++;
+        }
+    }
+    double elapsed = (double)(nowNs() - start) / 1e9;
+
+    printf("clients=%d depth=%d seconds=%.2f requests=%llu\n", opts.clients, opts.depth, elapsed, completed);
+    printf("requests/sec=%.0f\n", (double)completed / elapsed);
+    if (completed){
+        printf("latency_us p50=%.0f p99=%.0f p999=%.0f\n", percentile(hist, completed, 0.50),
+               percentile(hist, completed, 0.99), percentile(hist, completed, 0.999));
+    }
+    if (errors) printf("dropped_connections=%llu\n", errors);
+
+    for (int i = 0; i < opts.clients; i++){
+        if (conns[i].fd >= 0) close(conns[i].fd);
+    }
+    close(epfd);
+    free(conns);
+    free(hist);
+    free(buf);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
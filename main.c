@@ -1,8 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include "book.h"
 #include "cli_utils.h"
+#include "snapshot.h"
+#include "import.h"
+#include "batch.h"
+#include "journal.h"
+#include "search.h"
+#include "topk.h"
+#include "filter.h"
+#include "parallel.h"
+#include "server.h"
+#include "export.h"
+#include "stats.h"
+
+#define MAXPATH 256
+#define MAXINPUT 1024  // longest title or author read from the prompt
+#define BATCH_IO_BUFFER (1 << 16)
 
 
 // ============= COMMAND HANDLER PROTOTYPES =============
@@ -17,17 +34,127 @@ static void handleCount(Library *lib);
 static void handleSort(Library *lib);
 static void handleAverage(Library *lib);
 static void handleFreeList(Library *lib);
+static void handleSave(Library *lib);
+static void handleLoad(Library *lib);
+static void handleImport(Library *lib);
+static void handleCompact(Library *lib);
+static void handleSearch(Library *lib);
+static void handleRange(Library *lib);
+static void handleBuckets(Library *lib);
+static void handleTopRated(Library *lib);
+static void handleExport(Library *lib);
+static void handleStats(Library *lib);
+static void handleUndo(Library *lib);
+static void handleDefrag(Library *lib);
+static int runImport(Library *lib, const char *path, int batch);
+
+
+// ============= STARTUP OPTIONS =============
+
+typedef struct{
+    int batch;
+    const char *store;      // --store base: durable <base>.snap + <base>.journal
+    size_t top_cache;       // --top-cache k: keep the k best books ready
+    int isbn_filter;        // --isbn-filter: Bloom filter in front of ISBN lookups
+    int threads;            // --threads n: workers for sort/split, 0 for every CPU
+    const char *serve;      // --serve unix:<path>|tcp:<port>: answer batch commands over a socket
+    JournalConfig journal;
+}Options;
+
+static int parseOptions(int argc, char *argv[], Options *opts);
+static int runSnapshotTool(int argc, char *argv[]);
 
 
 // ============= MAIN FUNCTION =============
 
-int main(void){
+int main(int argc, char *argv[]){
+    // The snapshot tools work on files alone and never build a library
+    if (argc > 1 && (strcmp(argv[1], "--diff") == 0 || strcmp(argv[1], "--apply") == 0)){
+        return runSnapshotTool(argc, argv);
+    }
+
     Library *lib = createLibrary();
     if (!lib){
         printError("Failed to initialize library. Exiting.");
         return EXIT_FAILURE;
     }
 
+    Options opts;
+    if (!parseOptions(argc, argv, &opts)){
+        fprintf(stderr, "Usage: %s [--batch|--interactive] [--store base] [--sync-ms ms] [--sync-every n]\n"
+                        "       [--serve unix:path|tcp:port] [--threads n] [--top-cache k] [--isbn-filter]\n"
+                        "       [--load snapshot] [--import file.csv|file.jsonl]...\n"
+                        "       %s --diff old.snap new.snap > changes.diff\n"
+                        "       %s --apply base.snap changes.diff|- merged.snap\n", argv[0], argv[0], argv[0]);
+        destroyLibrary(lib);
+        return EXIT_FAILURE;
+    }
+    int batch = opts.batch;
+    if (opts.threads != 1) setWorkerThreads(opts.threads ? opts.threads : onlineCpus());
+
+    // Batch and server modes: no menu, colours or pauses
+    if (opts.serve) setMessagesEnabled(0);
+    if (batch){
+        setMessagesEnabled(0);
+        setvbuf(stdout, NULL, _IOFBF, BATCH_IO_BUFFER);
+    }
+
+    // The filter goes in first, so replaying the journal already checks through it
+    if (opts.isbn_filter && !setIsbnFilter(lib, 1)){
+        if (batch) fprintf(stderr, "Memory allocation failed!\n");
+        else printError("Memory allocation failed!");
+        destroyLibrary(lib);
+        return EXIT_FAILURE;
+    }
+
+    // The store is opened first so later --load/--import steps are journaled
+    if (opts.store && !openJournal(lib, opts.store, &opts.journal)){
+        if (batch || opts.serve) fprintf(stderr, "%s\n", lastMessage());
+        destroyLibrary(lib);
+        return EXIT_FAILURE;
+    }
+    if (opts.top_cache && !setTopCache(lib, opts.top_cache)){
+        if (batch) fprintf(stderr, "Memory allocation failed!\n");
+        else printError("Memory allocation failed!");
+        destroyLibrary(lib);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; i++){
+        int ok = 1;
+        if (strcmp(argv[i], "--load") == 0){
+            ok = loadSnapshot(lib, argv[++i]);
+        }
+        else if (strcmp(argv[i], "--import") == 0){
+            ok = runImport(lib, argv[++i], batch);
+        }
+        else if (strcmp(argv[i], "--store") == 0 || strcmp(argv[i], "--sync-ms") == 0 ||
+                 strcmp(argv[i], "--sync-every") == 0 || strcmp(argv[i], "--top-cache") == 0 ||
+                 strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "--serve") == 0){
+            i++;
+        }
+
+        if (!ok){
+            if (batch || opts.serve) fprintf(stderr, "%s\n", lastMessage());
+            destroyLibrary(lib);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.serve){
+        fprintf(stderr, "Serving on %s\n", opts.serve);
+        int ok = runServer(lib, opts.serve);
+        if (!ok) fprintf(stderr, "%s\n", lastMessage());
+        destroyLibrary(lib);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (batch){
+        int all_ok = runBatch(lib, stdin, stdout);
+        destroyLibrary(lib);
+        return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     printSuccess("Book Management System initialized!");
 
     while (1){
@@ -46,40 +173,145 @@ int main(void){
             case 8:  handleSort(lib); break;
             case 9:  handleAverage(lib); break;
             case 10: handleFreeList(lib); break;
-            case 11:
+            case 11: handleSave(lib); break;
+            case 12: handleLoad(lib); break;
+            case 13: handleImport(lib); break;
+            case 14: handleCompact(lib); break;
+            case 15: handleSearch(lib); break;
+            case 16: handleRange(lib); break;
+            case 17: handleBuckets(lib); break;
+            case 18: handleTopRated(lib); break;
+            case 19: handleExport(lib); break;
+            case 20: handleStats(lib); break;
+            case 21: handleUndo(lib); break;
+            case 22: handleDefrag(lib); break;
+            case 23:
                 printWarning("Cleaning up and exiting...");
                 destroyLibrary(lib);
                 return EXIT_SUCCESS;
             default:
                 printError("Invalid choice. Try again.");
         }
+        // Commands arrive at human pace, so make each one durable before the next prompt
+        syncJournal(lib->journal);
     }
 }
 
 
-// ============= COMMAND HANDLERS =============
+// Batch mode is chosen when asked for, or when stdin is not a terminal unless
+// --interactive; --load/--import are only validated here and run in order later
+static int parseOptions(int argc, char *argv[], Options *opts){
+    opts->batch = !isatty(STDIN_FILENO);
+    opts->store = NULL;
+    opts->top_cache = 0;
+    opts->isbn_filter = 0;
+    opts->threads = 1;
+    opts->serve = NULL;
+    opts->journal.sync_interval_ms = JOURNAL_DEFAULT_INTERVAL_MS;
+    opts->journal.sync_every = JOURNAL_DEFAULT_SYNC_EVERY;
 
-static void handleAddBooks(Library *lib){
-    if (lib->is_split){
-        printError("Cannot add books while library is split. Merge first.");
-        return;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--batch") == 0){
+            opts->batch = 1;
+        }
+        else if (strcmp(argv[i], "--interactive") == 0){
+            opts->batch = 0;
+        }
+        else if (strcmp(argv[i], "--isbn-filter") == 0){
+            opts->isbn_filter = 1;
+        }
+        else if (i + 1 >= argc){
+            return 0;
+        }
+        else if (strcmp(argv[i], "--store") == 0){
+            opts->store = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sync-ms") == 0){
+            opts->journal.sync_interval_ms = (unsigned)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--sync-every") == 0){
+            opts->journal.sync_every = (unsigned)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--serve") == 0){
+            opts->serve = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0){
+            opts->threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--top-cache") == 0){
+            opts->top_cache = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--load") == 0 || strcmp(argv[i], "--import") == 0){
+            i++;
+        }
+        else{
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// ============= SNAPSHOT TOOLS =============
+
+// --diff writes the changes to stdout and --apply reads them from a file or
+// stdin; either way the summary and any error go to stderr
+static int runSnapshotTool(int argc, char *argv[]){
+    int diff = strcmp(argv[1], "--diff") == 0;
+    if (argc != (diff ? 4 : 5)){
+        fprintf(stderr, diff ? "Usage: %s --diff old.snap new.snap > changes.diff\n" :
+                               "Usage: %s --apply base.snap changes.diff|- merged.snap\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    setMessagesEnabled(0);
+
+    SnapshotDiffStats stats;
+    int ok;
+    if (diff){
+        setvbuf(stdout, NULL, _IOFBF, BATCH_IO_BUFFER);
+        ok = diffSnapshots(argv[2], argv[3], stdout, &stats);
+    }
+    else{
+        FILE *changes = strcmp(argv[3], "-") == 0 ? stdin : fopen(argv[3], "r");
+        if (!changes){
+            fprintf(stderr, "Cannot open diff file.\n");
+            return EXIT_FAILURE;
+        }
+        ok = applySnapshotDiff(argv[2], changes, argv[4], &stats);
+        if (changes != stdin) fclose(changes);
     }
 
+    if (!ok){
+        fprintf(stderr, "%s\n", lastMessage());
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "added=%llu removed=%llu changed=%llu unchanged=%llu\n",
+            (unsigned long long)stats.added, (unsigned long long)stats.removed,
+            (unsigned long long)stats.changed, (unsigned long long)stats.unchanged);
+    return EXIT_SUCCESS;
+}
+
+
+// ============= COMMAND HANDLERS =============
+
+static void handleAddBooks(Library *lib){
     int num = getPositiveInteger("Number of books to add: ");
     
     for (int i = 1; i <= num; i++){
-        char title[MAXNAME], author[MAXNAME];
+        char title[MAXINPUT], author[MAXINPUT];
         printf(BOLD"\n--- Book %d ---\n"RESET, i);
         
-        getString("Title: ", title, MAXNAME);
-        getString("Author: ", author, MAXNAME);
+        getString("Title: ", title, MAXINPUT);
+        getString("Author: ", author, MAXINPUT);
         long isbn = getLong("ISBN: ");
         float rating = getRating("Rating (0.0-5.0): ");
         
-        if (addBook(lib, title, author, isbn, rating)){
+        BookStatus status = addBook(lib, title, author, isbn, rating);
+        if (status == BOOK_OK){
             printSuccess("Book added successfully!");
         }
         else{
+            printStatus(status, isbn);
             printWarning("Retrying this book...");
             i--;
         }
@@ -88,106 +320,146 @@ static void handleAddBooks(Library *lib){
 
 static void handleDisplay(Library *lib){
     if (lib->is_split){
-        char choice = getListChoice();
-        if (choice == 'a'){
-            displayBooks(lib->high_rated, "High-Rated Books");
-        }
-        else{
-            displayBooks(lib->low_rated, "Low-Rated Books");
-        }
+        char choice = getListChoice(lib);
+        char label[64], list_name[80];
+        formatBucket(lib, choice, label, sizeof(label));
+        snprintf(list_name, sizeof(list_name), "Books Rated %s", label);
+        displayBooks(lib, choice, list_name);
     }
     else{
-        displayBooks(lib->main_list, "All Books");
+        displayBooks(lib, 'm', "All Books");
     }
 }
 
 static void handleFind(Library *lib){
-    Book *list = lib->is_split ? 
-        getCurrentList(lib, getListChoice()) : lib->main_list;
+    char choice = lib->is_split ? getListChoice(lib) : 'm';
     
-    if (!list){
+    if (!getCurrentList(lib, choice)->head){
         printError("Selected list is empty.");
         return;
     }
     
     long isbn = getLong("Enter ISBN to search: ");
-    findBook(list, isbn);
+    Book *book = findBook(lib, choice, isbn);
+    if (!book){
+        printStatus(BOOK_NOT_FOUND, isbn);
+        return;
+    }
+    printSuccess("Book found!");
+    printInfo("Title: %s\nAuthor: %s\nISBN: %ld\nRating: %.1f★",
+              bookTitle(lib, book), bookAuthor(lib, book), book->isbn, book->rating);
 }
 
 static void handleDeleteLast(Library *lib){
-    deleteLastAddedBook(lib);
+    // Copy the names out first: the node goes back to the pool on delete
+    char title[MAXINPUT] = "", author[MAXINPUT] = "";
+    if (lib->last_added){
+        snprintf(title, sizeof(title), "%s", bookTitle(lib, lib->last_added));
+        snprintf(author, sizeof(author), "%s", bookAuthor(lib, lib->last_added));
+    }
+
+    BookStatus status = deleteLastAddedBook(lib);
+    if (status == BOOK_OK) printSuccess("Deleted last added book: '%s' by %s", title, author);
+    else if (status == BOOK_LIST_EMPTY) printError("List is empty, nothing to delete.");
+    else printStatus(status, 0);
 }
 
-static void handleDeleteByISBN(Library *lib){
-    long isbn = getLong("Enter ISBN to delete: ");
-    
-    if (lib->is_split){
-        char choice = getListChoice();
-        deleteBookByISBN(getCurrentListPtr(lib, choice), isbn);
+static void handleUndo(Library *lib){
+    const char *step = nextUndoName(lib);
+    BookStatus status = undoLastChange(lib);
+    if (status == BOOK_OK) printSuccess("Undid the last %s. %zu more step(s) can be undone.", step, undoSteps(lib));
+    else printStatus(status, 0);
+}
+
+static void handleDefrag(Library *lib){
+    BookLayout before, after;
+    measureBookLayout(lib, &before);
+    if (!before.books){
+        printError("Library is empty, nothing to defragment.");
+        return;
     }
-    else{
-        deleteBookByISBN(&lib->main_list, isbn);
+    int had_history = undoSteps(lib) > 0;
+    BookStatus status = defragmentBooks(lib);
+    if (status != BOOK_OK){
+        printStatus(status, 0);
+        return;
     }
+    measureBookLayout(lib, &after);
+    printSuccess("Relinked %zu books in list order: %zu links jumped elsewhere in memory, now %zu.",
+                 before.books, before.jumps, after.jumps);
+    printf("Reclaimed %.1fKB of node memory (%.1fKB -> %.1fKB) and %.1fKB of strings (%.1fKB -> %.1fKB, %.1fKB unused).\n"
+           "A walk over every list took %.2fms, now %.2fms (%.1fx).\n",
+           (double)(before.pool_bytes - after.pool_bytes) / 1024.0, (double)before.pool_bytes / 1024.0,
+           (double)after.pool_bytes / 1024.0, (double)(before.string_bytes - after.string_bytes) / 1024.0,
+           (double)before.string_bytes / 1024.0, (double)after.string_bytes / 1024.0,
+           (double)before.dead_string_bytes / 1024.0, (double)before.walk_ns / 1e6, (double)after.walk_ns / 1e6,
+           after.walk_ns ? (double)before.walk_ns / (double)after.walk_ns : 1.0);
+    if (had_history) printWarning("The undo history was cleared.");
+}
+
+static void handleDeleteByISBN(Library *lib){
+    long isbn = getLong("Enter ISBN to delete: ");
+    char choice = lib->is_split ? getListChoice(lib) : 'm';
+
+    BookStatus status = deleteBookByISBN(lib, choice, isbn);
+    if (status == BOOK_OK) printSuccess("Book with ISBN %ld deleted.", isbn);
+    else printStatus(status, isbn);
 }
 
 static void handleSplitMerge(Library *lib){
     char choice = getSplitMergeChoice();
     
     if (choice == 'a'){
-        splitLibrary(lib);
+        BookStatus status = splitLibrary(lib);
+        if (status == BOOK_OK) printSuccess("Library split into %d rating buckets.", lib->bucket_count);
+        else if (status == BOOK_LIST_EMPTY) printError("Cannot split: main library is empty.");
+        else printStatus(status, 0);
     }
     else{
-        mergeLibrary(lib);
+        BookStatus status = mergeLibrary(lib);
+        if (status == BOOK_OK) printSuccess("Library merged successfully.");
+        else printStatus(status, 0);
     }
 }
 
 static void handleCount(Library *lib){
-    int count;
-    const char *list_name;
-    
     if (lib->is_split){
-        char choice = getListChoice();
-        if (choice == 'a'){
-            count = countBooks(lib->high_rated);
-            list_name = "high-rated";
-        }
-        else{
-            count = countBooks(lib->low_rated);
-            list_name = "low-rated";
-        }
+        char choice = getListChoice(lib);
+        char label[64];
+        formatBucket(lib, choice, label, sizeof(label));
+        printf(BOLD"Number of books rated %s: %zu\n"RESET, label, countBooks(getCurrentList(lib, choice)));
     }
     else{
-        count = countBooks(lib->main_list);
-        list_name = "total";
+        printf(BOLD"Number of total books: %zu\n"RESET, countBooks(&lib->main_list));
     }
-    
-    printf(BOLD"Number of %s books: %d\n"RESET, list_name, count);
 }
 
 static void handleSort(Library *lib){
-    if (lib->is_split){
-        printWarning("Books are already sorted in split lists.");
-    }
-    else{
-        sortByRating(&lib->main_list);
+    char choice = lib->is_split ? getListChoice(lib) : 'm';
+
+    if (countBooks(getCurrentList(lib, choice)) < 2){
+        printWarning("List has fewer than 2 books. No sorting needed.");
+        return;
     }
+    sortByRating(lib, choice);
+    printSuccess("Books sorted by rating.");
 }
 
 static void handleAverage(Library *lib){
-    Book *list = lib->is_split ? 
-        getCurrentList(lib, getListChoice()) : lib->main_list;
+    BookList *list = lib->is_split ? 
+        getCurrentList(lib, getListChoice(lib)) : &lib->main_list;
     
-    float avg = averageRating(list);
+    double avg = averageRating(list);
     
-    if (avg == 0.0f){
+    if (!countBooks(list)){
         printError("No books in selected list.");
     }
     else{
         printf(BOLD"Average rating: %.2f★\n"RESET, avg);
-        if (avg >= 4.0f){
+        if (avg >= 4.0){
             printSuccess("Excellent collection!");
         }
-        else if (avg >= 3.0f){
+        else if (avg >= 3.0){
             printWarning("Good collection.");
         }
         else{
@@ -198,41 +470,256 @@ static void handleAverage(Library *lib){
 
 static void handleFreeList(Library *lib){
     if (!lib->is_split){
-        if (!lib->main_list){
+        if (!lib->main_list.head){
             printError("No list to free.");
         }
         else{
-            // Manually free the main list
-            Book *temp = lib->main_list;
-            while (temp){
-                Book *next = temp->next;
-                free(temp);
-                temp = next;
-            }
-            lib->main_list = NULL;
+            freeLibraryList(lib, 'm');
             printSuccess("Main list freed.");
         }
     }
     else{
-        char choice = getListChoice();
-        Book **listPtr = getCurrentListPtr(lib, choice);
+        char choice = getListChoice(lib);
+        BookList *list = getCurrentList(lib, choice);
         
-        if (!*listPtr){
+        if (!list->head){
             printError("Selected list is already empty.");
         }
         else{
-            Book *temp = *listPtr;
-            while (temp){
-                Book *next = temp->next;
-                free(temp);
-                temp = next;
-            }
-            *listPtr = NULL;
+            freeLibraryList(lib, choice);
             printSuccess("Selected list freed.");
         }
-        
-        if (!lib->high_rated && !lib->low_rated){
-            lib->is_split = 0;
+    }
+}
+
+static size_t totalBooks(Library *lib){
+    return lib->index.count;  // every book in every list is indexed; deleted ones held for undo are not
+}
+
+static void handleSave(Library *lib){
+    char path[MAXPATH];
+    getString("Snapshot file: ", path, MAXPATH);
+    if (!path[0]){
+        printError("No file name given.");
+        return;
+    }
+
+    if (saveSnapshot(lib, path)){
+        printf(BOLD GREEN"Saved %zu books to %s.\n"RESET, totalBooks(lib), path);
+    }
+}
+
+static void handleLoad(Library *lib){
+    char path[MAXPATH];
+    getString("Snapshot file: ", path, MAXPATH);
+    if (!path[0]){
+        printError("No file name given.");
+        return;
+    }
+
+    if (loadSnapshot(lib, path)){
+        printf(BOLD GREEN"Loaded %zu books from %s.\n"RESET, totalBooks(lib), path);
+    }
+}
+
+static int runImport(Library *lib, const char *path, int batch){
+    ImportStats stats;
+    int ok = importBooks(lib, path, &stats);
+    if (stats.rows){
+        double rate = stats.seconds > 0.0 ? (double)stats.rows / stats.seconds : 0.0;
+        if (batch){
+            // Keep stdout for command results
+            fprintf(stderr, "imported=%zu rows=%zu rejected=%zu seconds=%.3f rows_per_sec=%.0f\n",
+                    stats.imported, stats.rows, stats.rejected, stats.seconds, rate);
+        }
+        else{
+            printf(BOLD"Imported %zu of %zu rows (%zu rejected) in %.3fs, %.0f rows/sec.\n"RESET,
+                   stats.imported, stats.rows, stats.rejected, stats.seconds, rate);
+        }
+    }
+    return ok;
+}
+
+static void handleImport(Library *lib){
+    char path[MAXPATH];
+    getString("CSV or JSONL file: ", path, MAXPATH);
+    if (!path[0]){
+        printError("No file name given.");
+        return;
+    }
+    runImport(lib, path, 0);
+}
+
+static void handleCompact(Library *lib){
+    if (!lib->journal){
+        printError("No journal attached. Start with --store to enable journaling.");
+        return;
+    }
+    if (compactJournal(lib)){
+        printSuccess("Journal compacted into a new snapshot.");
+    }
+}
+
+static void printBookLines(Library *lib, Book **books, size_t count){
+    for (size_t i = 0; i < count; i++){
+        printf(BOLD"%zu. Title: %s\n"RESET, i + 1, bookTitle(lib, books[i]));
+        printf("   Author: %s | ISBN: %ld | Rating: %.1f★\n",
+               bookAuthor(lib, books[i]), books[i]->isbn, books[i]->rating);
+    }
+}
+
+static void handleSearch(Library *lib){
+    char choice = lib->is_split ? getListChoice(lib) : 'm';
+    SearchMode mode = getSearchChoice() == 'a' ? SEARCH_PREFIX : SEARCH_SUBSTRING;
+
+    char query[MAXINPUT];
+    getString("Title or author text: ", query, MAXINPUT);
+    if (!query[0]){
+        printError("No search text given.");
+        return;
+    }
+
+    Book **books;
+    size_t count;
+    if (!searchBooks(lib, choice, query, mode, SEARCH_ANY, &books, &count)){
+        printError("Memory allocation failed!");
+        return;
+    }
+    if (!count){
+        printWarning("No books match '%s'.", query);
+        return;
+    }
+
+    printf(BOLD BLUE"\n=== %zu match%s ===\n"RESET, count, count == 1 ? "" : "es");
+    printBookLines(lib, books, count);
+    free(books);
+}
+
+static void handleRange(Library *lib){
+    float lo = getRating("From rating (0.0-5.0): ");
+    float hi = getRating("Up to, not including (5.0 includes 5★ books): ");
+    if (hi >= 5.0f) hi = INFINITY;
+    if (lo >= hi){
+        printError("The range is empty.");
+        return;
+    }
+
+    Book **books;
+    size_t count;
+    if (!booksInRatingRange(lib, lo, hi, &books, &count)){
+        printError("Memory allocation failed!");
+        return;
+    }
+    if (!count){
+        printWarning("No books in that rating range.");
+        return;
+    }
+
+    printf(BOLD BLUE"\n=== %zu book%s, lowest rating first ===\n"RESET, count, count == 1 ? "" : "s");
+    printBookLines(lib, books, count);
+    free(books);
+}
+
+static void handleBuckets(Library *lib){
+    char input[MAXINPUT];
+    float cuts[MAX_BUCKETS - 1];
+    int count = 0;
+
+    getString("Rating cuts, highest first (e.g. 4.5 3.5 2): ", input, MAXINPUT);
+    for (char *p = input, *end; *p && count < MAX_BUCKETS - 1; p = end){
+        cuts[count] = strtof(p, &end);
+        if (end == p) break;
+        count++;
+    }
+    BookStatus status = setRatingBuckets(lib, cuts, count);
+    if (status != BOOK_OK){
+        printStatus(status, 0);
+        return;
+    }
+    printSuccess("Library now has %d rating buckets.", lib->bucket_count);
+    if (lib->is_split) printInfo("Books were redistributed into the new buckets.");
+}
+
+static void handleTopRated(Library *lib){
+    int highest = getRankChoice() == 'a';
+    size_t k = (size_t)getPositiveInteger("How many books: ");
+
+    Book **books;
+    size_t count;
+    if (!topRatedBooks(lib, 0, k, highest, &books, &count)){
+        printError("Memory allocation failed!");
+        return;
+    }
+    if (!count){
+        printWarning("No books in library.");
+        return;
+    }
+
+    printf(BOLD BLUE"\n=== %s %zu book%s ===\n"RESET, highest ? "Top" : "Bottom", count, count == 1 ? "" : "s");
+    printBookLines(lib, books, count);
+    free(books);
+}
+
+static void handleExport(Library *lib){
+    static const ExportFormat formats[] = {EXPORT_PLAIN, EXPORT_CSV, EXPORT_JSON};
+    ExportFormat format = formats[getExportChoice() - 'a'];
+
+    char path[MAXPATH];
+    getString("Export file: ", path, MAXPATH);
+    if (!path[0]){
+        printError("No file name given.");
+        return;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file){
+        printError("Cannot open %s.", path);
+        return;
+    }
+    exportHeader(format, file);
+    size_t written = exportLibrary(lib, 0, format, file);
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed){
+        printError("Writing %s failed.", path);
+        return;
+    }
+    printSuccess("Exported %zu books to %s.", written, path);
+}
+
+static void handleStats(Library *lib){
+    if (!statsEnabled()){
+        printWarning("Statistics were compiled out of this build.");
+        return;
+    }
+
+    int shown = 0;
+    for (int op = 0; op < STAT_OPS; op++){
+        OpStats stats;
+        readOpStats((StatOp)op, &stats);
+        if (!stats.calls) continue;
+        if (!shown){
+            printf(BOLD BLUE"\n=== Operation statistics ===\n"RESET);
+            printf(BOLD"%-12s %10s %10s %10s %10s %12s %12s\n"RESET,
+                   "operation", "calls", "mean", "p50 <", "p99 <", "max", "allocated");
         }
+        // A reset racing in-flight calls can leave calls counted but none timed
+        char mean[32] = "-";
+        if (stats.timed) snprintf(mean, sizeof(mean), "%.1fus", (double)stats.total_ns / (double)stats.timed / 1e3);
+        printf("%-12s %10llu %10s %8.1fus %8.1fus %10.1fus %10.1fKB\n", statOpName((StatOp)op),
+               (unsigned long long)stats.calls, mean,
+               (double)statPercentile(&stats, 0.50) / 1e3, (double)statPercentile(&stats, 0.99) / 1e3,
+               (double)stats.max_ns / 1e3, (double)stats.bytes / 1024.0);
+        shown++;
     }
-}
\ No newline at end of file
+    if (!shown) printWarning("No operations have run yet.");
+
+    IsbnFilterStats filter;
+    readIsbnFilterStats(lib, &filter);
+    if (isbnFilterEnabled(lib)){
+        printf(BOLD"\nISBN filter:"RESET" %.1fKB for %zu ISBNs (%zu stale), %llu checks, %llu skipped the index,\n"
+               "  false positives %.3f%% observed, %.3f%% expected\n",
+               (double)filter.bytes / 1024.0, filter.keys - filter.stale, filter.stale,
+               (unsigned long long)filter.checks, (unsigned long long)filter.skipped,
+               filter.observed_fpr * 100.0, filter.expected_fpr * 100.0);
+    }
+}
@@ -0,0 +1,125 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// Workers sleep on wake until generation changes, then claim tasks one at a
+// time under the lock; tasks are coarse (one list chunk each), so the lock is
+// never contended for long. The caller claims tasks too, then waits on done.
+static struct{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    pthread_mutex_t caller;  // one job at a time
+    pthread_t threads[MAX_WORKERS - 1];
+    int started;
+    int stopping;
+    unsigned long generation;
+    void (*job)(void *arg, size_t task);
+    void *arg;
+    size_t tasks;
+    size_t next;
+    size_t finished;
+}pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .caller = PTHREAD_MUTEX_INITIALIZER
+};
+
+static _Thread_local int inTask;  // set while this thread runs a task
+
+// Called and returns with pool.lock held
+static void runTasks(void){
+    while (pool.next < pool.tasks){
+        size_t task = pool.next++;
+        pthread_mutex_unlock(&pool.lock);
+        inTask = 1;
+        pool.job(pool.arg, task);
+        inTask = 0;
+        pthread_mutex_lock(&pool.lock);
+        if (++pool.finished == pool.tasks) pthread_cond_signal(&pool.done);
+    }
+}
+
+static void* workerMain(void *unused){
+    (void)unused;
+    pthread_mutex_lock(&pool.lock);
+    unsigned long seen = pool.generation;
+    while (1){
+        while (!pool.stopping && pool.generation == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+        if (pool.stopping) break;
+        seen = pool.generation;
+        runTasks();
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+static void stopWorkers(void){
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < pool.started; i++) pthread_join(pool.threads[i], NULL);
+    pool.started = 0;
+    pool.stopping = 0;
+}
+
+int setWorkerThreads(int count){
+    if (count < 1) count = 1;
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+
+    pthread_mutex_lock(&pool.caller);
+    int ok = 1;
+    if (count - 1 != pool.started){
+        stopWorkers();
+        while (pool.started < count - 1){
+            if (pthread_create(&pool.threads[pool.started], NULL, workerMain, NULL) != 0){
+                ok = 0;
+                break;
+            }
+            pool.started++;
+        }
+    }
+    pthread_mutex_unlock(&pool.caller);
+    return ok;
+}
+
+int workerThreads(void){
+    return pool.started + 1;
+}
+
+int onlineCpus(void){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > MAX_WORKERS ? MAX_WORKERS : (int)cpus;
+}
+
+void parallelFor(size_t tasks, void (*job)(void *arg, size_t task), void *arg){
+    // A task that starts a job of its own runs it inline: the pool is busy with its caller's job
+    if (inTask){
+        for (size_t i = 0; i < tasks; i++) job(arg, i);
+        return;
+    }
+    pthread_mutex_lock(&pool.caller);
+    if (!pool.started || tasks < 2){
+        pthread_mutex_unlock(&pool.caller);
+        for (size_t i = 0; i < tasks; i++) job(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.arg = arg;
+    pool.tasks = tasks;
+    pool.next = 0;
+    pool.finished = 0;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    runTasks();
+    while (pool.finished < pool.tasks) pthread_cond_wait(&pool.done, &pool.lock);
+    pool.job = NULL;
+    pool.tasks = 0;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.caller);
+}
@@ -0,0 +1,20 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+#define MAX_WORKERS 64  // threads taking part in a job, the caller included
+
+// Process-wide worker pool for bulk list operations. With 1 thread (the
+// default) every job runs on the caller. Returns 0 if new threads could not
+// be started; the pool then keeps the threads it has.
+int setWorkerThreads(int count);
+int workerThreads(void);
+int onlineCpus(void);
+
+// Runs job(arg, task) for every task in [0, tasks) on the pool and the
+// calling thread, and returns once all of them have finished. Called from
+// inside a task, it runs the tasks on that thread.
+void parallelFor(size_t tasks, void (*job)(void *arg, size_t task), void *arg);
+
+#endif // PARALLEL_H
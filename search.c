@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "stats.h"
+
+// Every field is indexed as the trigrams of "\1\1" + lower(text), so the
+// leading grams answer prefix queries and the rest substring queries. Each
+// gram maps to the ascending list of document ids containing it; a book's
+// document id lives in Book.doc. Deletes only clear the document slot; once
+// cleared slots outnumber live ones the index is dropped, whether or not
+// anyone searches, and the next search rebuilds it.
+#define SEARCH_MARK         '\1'
+#define SEARCH_MIN_SLOTS    1024
+#define SEARCH_REBUILD_SLACK 1024
+#define SEARCH_AUTHOR_KEY   (1u << 24)  // keeps title and author grams apart
+
+typedef struct{
+    uint32_t *docs;  // ascending
+    uint32_t count;
+    uint32_t capacity;
+}Posting;
+
+typedef struct{
+    uint32_t key;
+    uint32_t posting;  // index + 1 into postings; 0 marks an empty slot
+}GramSlot;
+
+struct SearchIndex{
+    GramSlot *slots;
+    size_t capacity;       // always a power of two
+    size_t grams;
+    Posting *postings;
+    size_t posting_capacity;
+    Book **docs;           // document id -> book, NULL once deleted
+    size_t doc_count;
+    size_t doc_capacity;
+    size_t live;
+};
+
+static unsigned char foldCase(unsigned char c){
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+static uint32_t gramKey(uint32_t field_key, unsigned char a, unsigned char b, unsigned char c){
+    return field_key | (uint32_t)a << 16 | (uint32_t)b << 8 | c;
+}
+
+static size_t hashGram(uint32_t key){
+    uint64_t x = key * 0x9E3779B97F4A7C15ull;
+    return (size_t)(x ^ (x >> 29));
+}
+
+// ============= GRAM TABLE =============
+
+static GramSlot* findSlot(GramSlot *slots, size_t capacity, uint32_t key){
+    size_t mask = capacity - 1;
+    size_t i = hashGram(key) & mask;
+    while (slots[i].posting && slots[i].key != key) i = (i + 1) & mask;
+    return &slots[i];
+}
+
+static int growGrams(SearchIndex *index){
+    size_t capacity = index->capacity ? index->capacity * 2 : SEARCH_MIN_SLOTS;
+    GramSlot *slots = calloc(capacity, sizeof(GramSlot));
+    Posting *postings = realloc(index->postings, capacity * sizeof(Posting));
+    if (!slots || !postings){
+        free(slots);
+        if (postings) index->postings = postings;
+        return 0;
+    }
+    STATS_BYTES(capacity * sizeof(GramSlot) + (capacity - index->posting_capacity) * sizeof(Posting));
+    for (size_t i = 0; i < index->capacity; i++){
+        if (index->slots[i].posting) *findSlot(slots, capacity, index->slots[i].key) = index->slots[i];
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    index->postings = postings;
+    index->posting_capacity = capacity;
+    return 1;
+}
+
+static const Posting* lookupGram(const SearchIndex *index, uint32_t key){
+    if (!index->capacity) return NULL;
+    const GramSlot *slot = findSlot(index->slots, index->capacity, key);
+    return slot->posting ? &index->postings[slot->posting - 1] : NULL;
+}
+
+static int addPosting(SearchIndex *index, uint32_t key, uint32_t doc){
+    if ((index->grams + 1) * 10 > index->capacity * 7 && !growGrams(index)) return 0;
+
+    GramSlot *slot = findSlot(index->slots, index->capacity, key);
+    if (!slot->posting){
+        index->postings[index->grams] = (Posting){0};
+        slot->key = key;
+        slot->posting = (uint32_t)++index->grams;
+    }
+
+    Posting *posting = &index->postings[slot->posting - 1];
+    if (posting->count && posting->docs[posting->count - 1] == doc) return 1;  // repeated gram
+    if (posting->count == posting->capacity){
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 4;
+        uint32_t *docs = realloc(posting->docs, capacity * sizeof(uint32_t));
+        if (!docs) return 0;
+        STATS_BYTES((capacity - posting->capacity) * sizeof(uint32_t));
+        posting->docs = docs;
+        posting->capacity = capacity;
+    }
+    posting->docs[posting->count++] = doc;
+    return 1;
+}
+
+static int indexField(SearchIndex *index, uint32_t field_key, const char *text, uint32_t doc){
+    unsigned char a = SEARCH_MARK, b = SEARCH_MARK;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++){
+        unsigned char c = foldCase(*p);
+        if (!addPosting(index, gramKey(field_key, a, b, c), doc)) return 0;
+        a = b;
+        b = c;
+    }
+    return 1;
+}
+
+// ============= MAINTENANCE =============
+
+int searchIndexAdd(SearchIndex *index, const Library *lib, Book *book){
+    if (index->doc_count == index->doc_capacity){
+        size_t capacity = index->doc_capacity ? index->doc_capacity * 2 : SEARCH_MIN_SLOTS;
+        if (capacity > UINT32_MAX) return 0;
+        Book **docs = realloc(index->docs, capacity * sizeof(Book *));
+        if (!docs) return 0;
+        STATS_BYTES((capacity - index->doc_capacity) * sizeof(Book *));
+        index->docs = docs;
+        index->doc_capacity = capacity;
+    }
+
+    uint32_t doc = (uint32_t)index->doc_count;
+    if (!indexField(index, 0, bookTitle(lib, book), doc) ||
+        !indexField(index, SEARCH_AUTHOR_KEY, bookAuthor(lib, book), doc)){
+        return 0;
+    }
+    book->doc = doc;
+    index->docs[index->doc_count++] = book;
+    index->live++;
+    return 1;
+}
+
+int searchIndexRemove(SearchIndex *index, const Book *book){
+    index->docs[book->doc] = NULL;
+    index->live--;
+    return index->doc_count - index->live <= index->live + SEARCH_REBUILD_SLACK;
+}
+
+void searchIndexMove(SearchIndex *index, Book *book){
+    index->docs[book->doc] = book;
+}
+
+void destroySearchIndex(SearchIndex *index){
+    if (!index) return;
+    for (size_t i = 0; i < index->grams; i++) free(index->postings[i].docs);
+    free(index->postings);
+    free(index->slots);
+    free(index->docs);
+    free(index);
+}
+
+// Indexes every book in list order, so document ids follow the lists
+static SearchIndex* buildSearchIndex(const Library *lib){
+    SearchIndex *index = calloc(1, sizeof(SearchIndex));
+    if (!index) return NULL;
+    STATS_BYTES(sizeof(SearchIndex));
+
+    for (int i = -1; i < lib->bucket_count; i++){
+        const BookList *list = i < 0 ? &lib->main_list : &lib->buckets[i];
+        for (Book *book = list->head; book; book = book->next){
+            if (!searchIndexAdd(index, lib, book)){
+                destroySearchIndex(index);
+                return NULL;
+            }
+        }
+    }
+    return index;
+}
+
+// ============= QUERIES =============
+
+typedef struct{
+    uint32_t *docs;
+    size_t count;
+    size_t capacity;
+}DocSet;
+
+static int pushDoc(DocSet *set, uint32_t doc){
+    if (set->count == set->capacity){
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        uint32_t *docs = realloc(set->docs, capacity * sizeof(uint32_t));
+        if (!docs) return 0;
+        STATS_BYTES((capacity - set->capacity) * sizeof(uint32_t));
+        set->docs = docs;
+        set->capacity = capacity;
+    }
+    set->docs[set->count++] = doc;
+    return 1;
+}
+
+// First position at or after from whose document id is >= doc
+static uint32_t gallop(const Posting *posting, uint32_t from, uint32_t doc){
+    uint32_t step = 1, lo = from, hi = from;
+    while (hi < posting->count && posting->docs[hi] < doc){
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > posting->count) hi = posting->count;
+    while (lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (posting->docs[mid] < doc) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int matchesText(const char *text, const unsigned char *query, size_t len, SearchMode mode){
+    const unsigned char *t = (const unsigned char *)text;
+    do{
+        size_t i = 0;
+        while (i < len && t[i] && foldCase(t[i]) == query[i]) i++;
+        if (i == len) return 1;
+    } while (mode == SEARCH_SUBSTRING && *t++);
+    return 0;
+}
+
+static int wanted(const Library *lib, const Book *book, char choice){
+    return book && (!choice || listChoiceOf(lib, book) == choice);
+}
+
+static const char* fieldText(const Library *lib, const Book *book, SearchField field){
+    return field == SEARCH_TITLE ? bookTitle(lib, book) : bookAuthor(lib, book);
+}
+
+// Appends the matching document ids of one field to out in ascending order
+static int searchField(const Library *lib, const SearchIndex *index, char choice, const unsigned char *query,
+                       size_t len, SearchMode mode, SearchField field, DocSet *out){
+    // Short substrings have no gram of their own: check every document
+    if (mode == SEARCH_SUBSTRING && len < 3){
+        for (size_t d = 0; d < index->doc_count; d++){
+            Book *book = index->docs[d];
+            if (wanted(lib, book, choice) && matchesText(fieldText(lib, book, field), query, len, mode) &&
+                !pushDoc(out, (uint32_t)d)){
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    // Grams of the query, with the start marker for prefixes
+    size_t ngrams = mode == SEARCH_PREFIX ? len : len - 2;
+    const Posting **lists = malloc(ngrams * sizeof(Posting *));
+    uint32_t *cursors = calloc(ngrams, sizeof(uint32_t));
+    if (!lists || !cursors){
+        free(lists);
+        free(cursors);
+        return 0;
+    }
+    STATS_BYTES(ngrams * (sizeof(Posting *) + sizeof(uint32_t)));
+    uint32_t field_key = field == SEARCH_AUTHOR ? SEARCH_AUTHOR_KEY : 0;
+    for (size_t i = 0; i < ngrams; i++){
+        unsigned char a = mode == SEARCH_PREFIX ? (i >= 2 ? query[i - 2] : SEARCH_MARK) : query[i];
+        unsigned char b = mode == SEARCH_PREFIX ? (i >= 1 ? query[i - 1] : SEARCH_MARK) : query[i + 1];
+        unsigned char c = mode == SEARCH_PREFIX ? query[i] : query[i + 2];
+        lists[i] = lookupGram(index, gramKey(field_key, a, b, c));
+        if (!lists[i]){
+            free(lists);
+            free(cursors);
+            return 1;  // some gram never occurs, so nothing can match
+        }
+    }
+
+    // Drive the intersection from the rarest gram
+    for (size_t i = 1; i < ngrams; i++){
+        const Posting *list = lists[i];
+        size_t j = i;
+        for (; j > 0 && lists[j - 1]->count > list->count; j--) lists[j] = lists[j - 1];
+        lists[j] = list;
+    }
+
+    int ok = 1;
+    const Posting *driver = lists[0];
+    for (uint32_t k = 0; ok && k < driver->count; k++){
+        uint32_t doc = driver->docs[k];
+        size_t i = 1;
+        for (; i < ngrams; i++){
+            cursors[i] = gallop(lists[i], cursors[i], doc);
+            if (cursors[i] == lists[i]->count || lists[i]->docs[cursors[i]] != doc) break;
+        }
+        if (i < ngrams){
+            if (cursors[i] == lists[i]->count) break;  // a list ran out: no further matches
+            continue;
+        }
+
+        // Every gram is present; confirm they line up in the live text
+        Book *book = index->docs[doc];
+        if (wanted(lib, book, choice) && matchesText(fieldText(lib, book, field), query, len, mode)){
+            ok = pushDoc(out, doc);
+        }
+    }
+    free(lists);
+    free(cursors);
+    return ok;
+}
+
+int searchBooks(Library *lib, char choice, const char *query, SearchMode mode, SearchField fields,
+                Book ***results, size_t *count){
+    STATS_SCOPE(STAT_SEARCH);
+    *results = NULL;
+    *count = 0;
+    size_t len = strlen(query);
+    if (!len) return 1;
+
+    SearchIndex *index = lib->search;
+    if (!index){
+        lib->search = index = buildSearchIndex(lib);
+        if (!index) return 0;
+    }
+
+    unsigned char *folded = malloc(len);
+    if (!folded) return 0;
+    for (size_t i = 0; i < len; i++) folded[i] = foldCase((unsigned char)query[i]);
+
+    DocSet titles = {0}, authors = {0};
+    int ok = (!(fields & SEARCH_TITLE) ||
+              searchField(lib, index, choice, folded, len, mode, SEARCH_TITLE, &titles)) &&
+             (!(fields & SEARCH_AUTHOR) ||
+              searchField(lib, index, choice, folded, len, mode, SEARCH_AUTHOR, &authors));
+    free(folded);
+
+    // Union of the two ascending id lists, in document order
+    Book **books = NULL;
+    size_t total = titles.count + authors.count;
+    if (ok && total && !(books = malloc(total * sizeof(Book *)))) ok = 0;
+    if (books) STATS_BYTES(total * sizeof(Book *));
+    if (ok && total){
+        size_t i = 0, j = 0, n = 0;
+        while (i < titles.count || j < authors.count){
+            uint32_t doc;
+            if (j == authors.count || (i < titles.count && titles.docs[i] < authors.docs[j])) doc = titles.docs[i++];
+            else if (i == titles.count || authors.docs[j] < titles.docs[i]) doc = authors.docs[j++];
+            else{
+                doc = titles.docs[i++];
+                j++;
+            }
+            books[n++] = index->docs[doc];
+        }
+        *results = books;
+        *count = n;
+    }
+    free(titles.docs);
+    free(authors.docs);
+    return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include "book.h"
+
+// Trigram index over lower-cased titles and authors. It is built on the first
+// search and kept up to date by book.c from then on.
+typedef struct SearchIndex SearchIndex;
+
+typedef enum{
+    SEARCH_PREFIX,     // field starts with the query
+    SEARCH_SUBSTRING   // query appears anywhere in the field
+}SearchMode;
+
+typedef enum{
+    SEARCH_TITLE  = 1,
+    SEARCH_AUTHOR = 2,
+    SEARCH_ANY    = 3
+}SearchField;
+
+// Finds books whose fields match query, ignoring ASCII case, in list 'm' or a
+// bucket ('a', 'b', ...), or in every list when choice is 0. *results is a malloc'd array of
+// *count books in insertion order (NULL when there are none). Returns 0 only
+// when memory runs out. Substring queries shorter than 3 bytes scan the list.
+int searchBooks(Library *lib, char choice, const char *query, SearchMode mode, SearchField fields,
+                Book ***results, size_t *count);
+
+// Mutation hooks called by book.c
+int searchIndexAdd(SearchIndex *index, const Library *lib, Book *book);
+int searchIndexRemove(SearchIndex *index, const Book *book);  // 0: mostly cleared slots, drop the index
+void searchIndexMove(SearchIndex *index, Book *book);  // book is a copy of its indexed node
+void destroySearchIndex(SearchIndex *index);
+
+#endif // SEARCH_H
@@ -0,0 +1,393 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "server.h"
+#include "batch.h"
+#include "cli_utils.h"
+#include "journal.h"
+
+// One thread, one level-triggered epoll set. Each readiness event reads what
+// the client has sent, runs every complete line through executeCommand and
+// queues the replies in fixed-size blocks that go out with one writev. A
+// client that stops reading has its input paused once SERVER_OUTPUT_LIMIT
+// bytes are queued for it, so a slow reader cannot grow the server unbounded.
+#define SERVER_INPUT_SIZE   (2 * BATCH_MAXLINE)
+#define SERVER_BLOCK_SIZE   (16 * 1024)
+#define SERVER_MAX_IOV      64
+#define SERVER_MAX_EVENTS   256
+#define SERVER_OUTPUT_LIMIT (4u << 20)
+#define SERVER_TICK_MS      100  // wakes an idle loop so group commit still runs
+
+typedef struct OutBlock{
+    struct OutBlock *next;
+    size_t start;  // unsent bytes are data[start, end)
+    size_t end;
+    char data[SERVER_BLOCK_SIZE];
+}OutBlock;
+
+typedef struct Client{
+    struct Client *prev;
+    struct Client *next;
+    int fd;
+    uint32_t events;   // current epoll interest
+    int quit;          // quit seen: run nothing more, flush the replies, then close
+    int eof;           // the client is done sending
+    int skipping;      // discarding the rest of an overlong line
+    size_t in_used;
+    OutBlock *head;
+    OutBlock *tail;
+    size_t pending;    // queued reply bytes
+    BatchSession session;  // display cursor; no commands that open files
+    char in[SERVER_INPUT_SIZE];
+}Client;
+
+typedef struct{
+    Library *lib;
+    int epfd;
+    int listen_fd;
+    Client *clients;
+    OutBlock *spare;   // recycled blocks
+    FILE *reply;       // memory stream executeCommand writes into
+    char *reply_buf;
+    size_t reply_size;
+}Server;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int sig){
+    (void)sig;
+    stopRequested = 1;
+}
+
+// ============= ENDPOINTS =============
+
+static int openListener(const char *address){
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0){
+        const char *path = address + 5;
+        struct sockaddr_un addr = {0};
+        if (!*path || strlen(path) >= sizeof(addr.sun_path)){
+            printError("Socket path '%s' is empty or too long.", path);
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+
+        // A socket file left by an earlier run would make bind fail
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+        // Only the server's own user may connect: the socket file is
+        // created 0600 rather than left to the umask
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        mode_t old_mask = umask(0177);
+        int bound = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        umask(old_mask);
+        if (!bound){
+            printError("Cannot bind '%s': %s", path, strerror(errno));
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    else if (strncmp(address, "tcp:", 4) == 0){
+        char *end;
+        long port = strtol(address + 4, &end, 10);
+        if (end == address + 4 || *end || port < 1 || port > 65535){
+            printError("Invalid port in '%s'.", address);
+            return -1;
+        }
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int one = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+            printError("Cannot bind port %ld: %s", port, strerror(errno));
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    else{
+        printError("Address must be unix:<path> or tcp:<port>.");
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) != 0){
+        printError("Cannot listen: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Thousands of clients need thousands of descriptors
+static void raiseFileLimit(void){
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// ============= OUTPUT QUEUE =============
+
+static int queueOutput(Server *srv, Client *c, const char *data, size_t len){
+    while (len){
+        OutBlock *block = c->tail;
+        if (!block || block->end == SERVER_BLOCK_SIZE){
+            block = srv->spare;
+            if (block) srv->spare = block->next;
+            else if (!(block = malloc(sizeof(OutBlock)))) return 0;
+            block->next = NULL;
+            block->start = block->end = 0;
+            if (c->tail) c->tail->next = block;
+            else c->head = block;
+            c->tail = block;
+        }
+        size_t room = SERVER_BLOCK_SIZE - block->end;
+        size_t n = len < room ? len : room;
+        memcpy(block->data + block->end, data, n);
+        block->end += n;
+        c->pending += n;
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+// Sends as much as the socket takes; 0 on a write error
+static int flushClient(Server *srv, Client *c){
+    while (c->head){
+        struct iovec iov[SERVER_MAX_IOV];
+        int count = 0;
+        for (OutBlock *b = c->head; b && count < SERVER_MAX_IOV; b = b->next){
+            iov[count].iov_base = b->data + b->start;
+            iov[count].iov_len = b->end - b->start;
+            count++;
+        }
+
+        ssize_t sent = writev(c->fd, iov, count);
+        if (sent < 0){
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        c->pending -= (size_t)sent;
+        while (sent > 0){
+            OutBlock *b = c->head;
+            size_t unsent = b->end - b->start;
+            if ((size_t)sent < unsent){
+                b->start += (size_t)sent;
+                break;
+            }
+            sent -= (ssize_t)unsent;
+            c->head = b->next;
+            b->next = srv->spare;
+            srv->spare = b;
+        }
+        if (!c->head) c->tail = NULL;
+    }
+    return 1;
+}
+
+// ============= CLIENTS =============
+
+static void dropClient(Server *srv, Client *c){
+    epoll_ctl(srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    while (c->head){
+        OutBlock *b = c->head;
+        c->head = b->next;
+        b->next = srv->spare;
+        srv->spare = b;
+    }
+    if (c->prev) c->prev->next = c->next;
+    else srv->clients = c->next;
+    if (c->next) c->next->prev = c->prev;
+    free(c);
+}
+
+static void acceptClients(Server *srv){
+    while (1){
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;  // EAGAIN once the backlog is empty; EMFILE and friends wait for the next round
+
+        Client *c = malloc(sizeof(Client));
+        if (!c){
+            close(fd);
+            continue;
+        }
+        memset(c, 0, offsetof(Client, in));
+        c->fd = fd;
+        c->session.no_files = 1;
+        c->events = EPOLLIN;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0){
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->next = srv->clients;
+        if (srv->clients) srv->clients->prev = c;
+        srv->clients = c;
+    }
+}
+
+static int runLine(Server *srv, Client *c, char *line){
+    rewind(srv->reply);
+    int status = executeCommand(srv->lib, &c->session, line, srv->reply);
+    fflush(srv->reply);
+    if (status == BATCH_QUIT) c->quit = 1;
+    return queueOutput(srv, c, srv->reply_buf, (size_t)ftello(srv->reply));
+}
+
+// Runs every complete buffered line, stopping early while too much output is
+// queued; whatever is left waits for the next round
+static int processInput(Server *srv, Client *c){
+    static const char too_long[] = "err line too long\n";
+    size_t start = 0;
+    while (!c->quit && c->pending < SERVER_OUTPUT_LIMIT){
+        char *line = c->in + start;
+        char *newline = memchr(line, '\n', c->in_used - start);
+        if (!newline){
+            if (!c->skipping && c->in_used - start < BATCH_MAXLINE - 1) break;
+            // No newline within a command's length: report it once, then
+            // drop input up to the next newline, as runBatch does
+            if (!c->skipping && !queueOutput(srv, c, too_long, sizeof(too_long) - 1)) return 0;
+            c->skipping = 1;
+            start = c->in_used;
+            break;
+        }
+
+        size_t len = (size_t)(newline - line);
+        *newline = '\0';
+        start += len + 1;
+        if (c->skipping){
+            c->skipping = 0;
+        }
+        else if (len > BATCH_MAXLINE - 2){
+            if (!queueOutput(srv, c, too_long, sizeof(too_long) - 1)) return 0;
+        }
+        else if (!runLine(srv, c, line)){
+            return 0;
+        }
+    }
+    memmove(c->in, c->in + start, c->in_used - start);
+    c->in_used -= start;
+    return 1;
+}
+
+// Returns 0 once the client is gone
+static int serveClient(Server *srv, Client *c, uint32_t events){
+    if (events & (EPOLLERR | EPOLLHUP)){
+        dropClient(srv, c);
+        return 0;
+    }
+    if ((events & EPOLLIN) && c->in_used < SERVER_INPUT_SIZE){
+        ssize_t n = read(c->fd, c->in + c->in_used, SERVER_INPUT_SIZE - c->in_used);
+        if (n > 0){
+            c->in_used += (size_t)n;
+        }
+        else if (n == 0){
+            // Replies to what was already sent still go out; a last line
+            // without a newline counts, as it does for runBatch
+            c->eof = 1;
+            if (c->skipping) c->in_used = 0;
+            else if (c->in_used && c->in[c->in_used - 1] != '\n') c->in[c->in_used++] = '\n';
+        }
+        else if (errno != EAGAIN && errno != EINTR){
+            dropClient(srv, c);
+            return 0;
+        }
+    }
+
+    // Also picks up lines held back while output was over the limit
+    while (1){
+        if (!processInput(srv, c) || !flushClient(srv, c)){
+            dropClient(srv, c);
+            return 0;
+        }
+        if (c->quit || c->pending >= SERVER_OUTPUT_LIMIT || !memchr(c->in, '\n', c->in_used)) break;
+    }
+
+    uint32_t wanted = 0;
+    if (!c->quit && !c->eof && c->pending < SERVER_OUTPUT_LIMIT) wanted |= EPOLLIN;
+    if (c->head) wanted |= EPOLLOUT;
+    if (!wanted){
+        dropClient(srv, c);
+        return 0;
+    }
+    if (wanted != c->events){
+        struct epoll_event ev = {.events = wanted, .data.ptr = c};
+        epoll_ctl(srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = wanted;
+    }
+    return 1;
+}
+
+// ============= EVENT LOOP =============
+
+int runServer(Library *lib, const char *address){
+    Server srv = {.lib = lib, .epfd = -1, .listen_fd = -1};
+    raiseFileLimit();
+    srv.listen_fd = openListener(address);
+    if (srv.listen_fd < 0) return 0;
+
+    srv.epfd = epoll_create1(EPOLL_CLOEXEC);
+    srv.reply = open_memstream(&srv.reply_buf, &srv.reply_size);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (srv.epfd < 0 || !srv.reply || epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.listen_fd, &ev) != 0){
+        printError("Cannot start the event loop: %s", strerror(errno));
+        if (srv.reply) fclose(srv.reply);
+        free(srv.reply_buf);
+        if (srv.epfd >= 0) close(srv.epfd);
+        close(srv.listen_fd);
+        return 0;
+    }
+
+    struct sigaction stop = {0};
+    stop.sa_handler = onStopSignal;  // no SA_RESTART, so epoll_wait returns
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);  // a vanished client shows up as EPIPE instead
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!stopRequested){
+        int n = epoll_wait(srv.epfd, events, SERVER_MAX_EVENTS, lib->journal ? SERVER_TICK_MS : -1);
+        for (int i = 0; i < n; i++){
+            if (events[i].data.ptr) serveClient(&srv, events[i].data.ptr, events[i].events);
+            else acceptClients(&srv);
+        }
+        syncJournalIfDue(lib->journal);
+    }
+
+    while (srv.clients){
+        flushClient(&srv, srv.clients);  // best effort, the socket may still be full
+        dropClient(&srv, srv.clients);
+    }
+    while (srv.spare){
+        OutBlock *b = srv.spare;
+        srv.spare = b->next;
+        free(b);
+    }
+    fclose(srv.reply);
+    free(srv.reply_buf);
+    close(srv.epfd);
+    close(srv.listen_fd);
+    if (strncmp(address, "unix:", 5) == 0) unlink(address + 5);
+    return 1;
+}
@@ -0,0 +1,12 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "book.h"
+
+// Serves the batch protocol (see batch.h) to many clients at once on
+// "unix:<path>" or "tcp:<port>" (loopback only). Clients may pipeline
+// commands; replies come back in order. Runs until SIGINT or SIGTERM and
+// returns 1 on a clean shutdown, 0 if the endpoint could not be opened.
+int runServer(Library *lib, const char *address);
+
+#endif // SERVER_H
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include "sharded.h"
+#include "parallel.h"
+
+// ============= SHARDS =============
+
+ShardedLibrary* createShardedLibrary(int shards){
+    if (shards < 1) shards = 1;
+    if (shards > MAX_SHARDS) shards = MAX_SHARDS;
+
+    ShardedLibrary *sl = calloc(1, sizeof(ShardedLibrary));
+    if (!sl) return NULL;
+    for (sl->count = 0; sl->count < shards; sl->count++){
+        Library *shard = createLibrary();
+        if (!shard || !enableSharedAccess(shard)){
+            destroyLibrary(shard);
+            destroyShardedLibrary(sl);
+            return NULL;
+        }
+        sl->shards[sl->count] = shard;
+    }
+    return sl;
+}
+
+void destroyShardedLibrary(ShardedLibrary *sl){
+    if (!sl) return;
+    for (int i = 0; i < sl->count; i++) destroyLibrary(sl->shards[i]);
+    free(sl);
+}
+
+// Fibonacci hashing keeps the high bits; each shard's own ISBN index hashes
+// differently, so the books of one shard still spread over its whole table
+Library* shardFor(const ShardedLibrary *sl, long isbn){
+    uint64_t hash = (uint64_t)isbn * 0x9E3779B97F4A7C15ull;
+    return sl->shards[(hash >> 32) % (uint64_t)sl->count];
+}
+
+// Shards are always locked in index order, so holding all of them cannot
+// deadlock against a thread that holds one
+static void readAll(ShardedLibrary *sl){
+    for (int i = 0; i < sl->count; i++) beginRead(sl->shards[i]);
+}
+
+static void releaseAll(ShardedLibrary *sl){
+    for (int i = sl->count - 1; i >= 0; i--) endAccess(sl->shards[i]);
+}
+
+// ============= SHARD-LOCAL OPERATIONS =============
+
+BookStatus shardedAddBook(ShardedLibrary *sl, const char *title, const char *author, long isbn, float rating){
+    Library *shard = shardFor(sl, isbn);
+    beginWrite(shard);
+    BookStatus status = addBook(shard, title, author, isbn, rating);
+    endAccess(shard);
+    return status;
+}
+
+BookStatus shardedDeleteBook(ShardedLibrary *sl, long isbn){
+    Library *shard = shardFor(sl, isbn);
+    beginWrite(shard);
+    BookStatus status = deleteBookByISBN(shard, 'm', isbn);
+    endAccess(shard);
+    return status;
+}
+
+const Book* shardedFindBook(ShardedLibrary *sl, long isbn, Library **shard){
+    *shard = shardFor(sl, isbn);
+    beginRead(*shard);
+    const Book *book = findBook(*shard, 'm', isbn);
+    if (!book) endAccess(*shard);
+    return book;
+}
+
+// ============= SCATTER/GATHER =============
+
+size_t shardedCount(ShardedLibrary *sl){
+    size_t count = 0;
+    readAll(sl);
+    for (int i = 0; i < sl->count; i++) count += countBooks(&sl->shards[i]->main_list);
+    releaseAll(sl);
+    return count;
+}
+
+double shardedAverageRating(ShardedLibrary *sl){
+    RatingSum sum = 0;
+    size_t count = 0;
+    readAll(sl);
+    for (int i = 0; i < sl->count; i++){
+        sum += sl->shards[i]->main_list.rating_sum;
+        count += sl->shards[i]->main_list.count;
+    }
+    releaseAll(sl);
+    return meanRating(sum, count);
+}
+
+static void sortShardJob(void *arg, size_t task){
+    Library *shard = ((ShardedLibrary *)arg)->shards[task];
+    beginWrite(shard);
+    sortByRating(shard, 'm');
+    endAccess(shard);
+}
+
+BookStatus shardedSortByRating(ShardedLibrary *sl){
+    parallelFor((size_t)sl->count, sortShardJob, sl);
+    return BOOK_OK;
+}
+
+// Orders shard heads by rating; on a tie the lower shard wins
+static int headBefore(const Book *const *heads, int a, int b){
+    float x = heads[a]->rating, y = heads[b]->rating;
+    return x < y || (x == y && a < b);
+}
+
+static void siftHead(const Book *const *heads, int *heap, int n){
+    int i = 0, shard = heap[0];
+    while (2 * i + 1 < n){
+        int child = 2 * i + 1;
+        if (child + 1 < n && headBefore(heads, heap[child + 1], heap[child])) child++;
+        if (!headBefore(heads, heap[child], shard)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = shard;
+}
+
+size_t shardedExport(ShardedLibrary *sl, int by_rating, ExportFormat format, FILE *out){
+    size_t written = 0;
+    readAll(sl);
+    exportBegin(out);
+    if (!by_rating){
+        for (int i = 0; i < sl->count; i++){
+            for (const Book *book = sl->shards[i]->main_list.head; book; book = book->next){
+                exportRecord(sl->shards[i], book, ++written, format);
+            }
+        }
+    }
+    else{
+        const Book *heads[MAX_SHARDS];
+        int heap[MAX_SHARDS], n = 0;
+        for (int i = 0; i < sl->count; i++){
+            heads[i] = sl->shards[i]->main_list.head;
+            if (!heads[i]) continue;
+            int j = n++;
+            for (; j > 0 && headBefore(heads, i, heap[(j - 1) / 2]); j = (j - 1) / 2) heap[j] = heap[(j - 1) / 2];
+            heap[j] = i;
+        }
+        while (n){
+            int shard = heap[0];
+            exportRecord(sl->shards[shard], heads[shard], ++written, format);
+            heads[shard] = heads[shard]->next;
+            if (!heads[shard]) heap[0] = heap[--n];
+            if (n) siftHead(heads, heap, n);
+        }
+    }
+    exportEnd();
+    releaseAll(sl);
+    return written;
+}
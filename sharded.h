@@ -0,0 +1,51 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <stdio.h>
+#include "book.h"
+#include "export.h"
+#include "shared.h"
+
+// A library spread by ISBN hash over independent shard libraries, each with
+// its own lists, indexes and reader-writer lock. An operation on one ISBN
+// locks only its shard, so threads working on different shards never wait
+// for each other. Whole-library operations visit every shard: counts and
+// averages add up the shards' running totals, sorting sorts the shards in
+// parallel, and ordered output merges the sorted shards as it goes.
+// Shards are never split into rating buckets; every book is in a main_list.
+
+#define MAX_SHARDS 64
+
+typedef struct{
+    Library *shards[MAX_SHARDS];
+    int count;
+}ShardedLibrary;
+
+// shards is clamped to [1, MAX_SHARDS]; NULL when memory runs out
+ShardedLibrary* createShardedLibrary(int shards);
+void destroyShardedLibrary(ShardedLibrary *sl);
+Library* shardFor(const ShardedLibrary *sl, long isbn);
+
+// One shard, under its lock
+BookStatus shardedAddBook(ShardedLibrary *sl, const char *title, const char *author, long isbn, float rating);
+BookStatus shardedDeleteBook(ShardedLibrary *sl, long isbn);
+
+// When found, the book's shard stays read-locked so the caller can read the
+// book through it; release it with endAccess(*shard). NULL holds nothing.
+const Book* shardedFindBook(ShardedLibrary *sl, long isbn, Library **shard);
+
+// Every shard. Counts and averages hold all the read locks at once, so they
+// see one consistent state; the fixed-point rating sums make the average exact.
+size_t shardedCount(ShardedLibrary *sl);
+double shardedAverageRating(ShardedLibrary *sl);
+
+// Sorts every shard's main_list on the worker pool, one task per shard
+BookStatus shardedSortByRating(ShardedLibrary *sl);
+
+// Writes every book, numbered from 1, under all the read locks. With
+// by_rating the shards (sorted first by shardedSortByRating) are merged k ways
+// into one ascending order, ties going to the lower shard; otherwise they are
+// written one after another. Returns the number written.
+size_t shardedExport(ShardedLibrary *sl, int by_rating, ExportFormat format, FILE *out);
+
+#endif // SHARDED_H
@@ -0,0 +1,47 @@
+#define _GNU_SOURCE  // writer-preferring rwlocks
+#include <stdlib.h>
+#include <pthread.h>
+#include "shared.h"
+
+struct LibraryLock{
+    pthread_rwlock_t rwlock;
+};
+
+int enableSharedAccess(Library *lib){
+    if (lib->lock) return 1;
+
+    struct LibraryLock *lock = malloc(sizeof(struct LibraryLock));
+    if (!lock) return 0;
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    // glibc prefers readers by default, which lets a busy read load lock the writer out
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int rc = pthread_rwlock_init(&lock->rwlock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if (rc != 0){
+        free(lock);
+        return 0;
+    }
+    lib->lock = lock;
+    return 1;
+}
+
+void beginRead(Library *lib){
+    if (lib->lock) pthread_rwlock_rdlock(&lib->lock->rwlock);
+}
+
+void beginWrite(Library *lib){
+    if (lib->lock) pthread_rwlock_wrlock(&lib->lock->rwlock);
+}
+
+void endAccess(Library *lib){
+    if (lib->lock) pthread_rwlock_unlock(&lib->lock->rwlock);
+}
+
+void destroyLibraryLock(struct LibraryLock *lock){
+    if (!lock) return;
+    pthread_rwlock_destroy(&lock->rwlock);
+    free(lock);
+}
@@ -0,0 +1,25 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "book.h"
+
+// Shared access for libraries used by several threads. Once enabled, every
+// caller brackets each operation with a read or a write section: any number of
+// readers run together (findBook, countBooks, averageRating, list walks),
+// while a writer waits for them to leave and then runs alone, so a node is
+// never freed under a reader. Waiting writers go ahead of newly arriving
+// readers, so a steady read load cannot starve them. Both sections are no-ops
+// until sharing is enabled.
+//
+// Reads that build an index on first use (searchBooks, booksInRatingRange,
+// topRatedBooks with a live cache) mutate the library and need a write section.
+// Call before the library is handed to other threads; 0 only when the lock
+// cannot be created
+int enableSharedAccess(Library *lib);
+void beginRead(Library *lib);
+void beginWrite(Library *lib);
+void endAccess(Library *lib);
+
+void destroyLibraryLock(struct LibraryLock *lock);  // called by destroyLibrary
+
+#endif // SHARED_H
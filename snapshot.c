@@ -0,0 +1,852 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "journal.h"
+#include "topk.h"
+#include "filter.h"
+#include "cli_utils.h"
+
+// On-disk layout is native-endian; record_size guards against ABI drift
+#define SNAPSHOT_MAGIC     "BKSN"
+#define SNAPSHOT_VERSION   5  // v2 adds journal_lsn, v3 the string section, v4 rating buckets, v5 the ISBN order
+#define SNAPSHOT_SPLIT     0x1u
+#define SNAPSHOT_HAS_LAST  0x2u
+#define SNAPSHOT_BY_ISBN   0x4u  // v5: the strings are followed by every record number in ISBN order
+#define SNAPSHOT_IO_BUFFER (1 << 20)
+#define SNAPSHOT_MAXPATH   4096
+
+typedef struct{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t flags;
+    uint64_t counts[3];       // records for main, then (before v4) high- and low-rated
+    int64_t last_added_isbn;  // valid when SNAPSHOT_HAS_LAST is set
+    uint64_t journal_lsn;     // last journal record folded into this snapshot (v2)
+    uint64_t strings_size;    // bytes of string arena after the records (v3)
+    uint32_t bucket_count;    // v4: bucket lists that follow main, in file order
+    float cuts[MAX_BUCKETS - 1];
+    uint64_t bucket_counts[MAX_BUCKETS];
+}SnapshotHeader;
+
+#define SNAPSHOT_V1_HEADER offsetof(SnapshotHeader, journal_lsn)
+#define SNAPSHOT_V2_HEADER offsetof(SnapshotHeader, strings_size)
+#define SNAPSHOT_V3_HEADER offsetof(SnapshotHeader, bucket_count)
+
+// v3 records point into the string section, which is the arena written verbatim
+typedef struct{
+    int64_t isbn;
+    float rating;
+    uint32_t title;
+    uint32_t author;
+}SnapshotRecord;
+
+// v1/v2 records carried fixed-width, NUL-padded strings
+#define LEGACY_MAXNAME 100
+
+typedef struct{
+    int64_t isbn;
+    float rating;
+    char title[LEGACY_MAXNAME];
+    char author[LEGACY_MAXNAME];
+}LegacyRecord;
+
+// ============= ISBN ORDER =============
+
+// Records stay in list order, so v5 appends a u32 record number per book in
+// ISBN order; a diff can then walk two snapshots side by side without sorting
+typedef struct{
+    uint64_t key;     // ISBN with the sign bit flipped, so unsigned order is numeric order
+    uint32_t record;
+}IsbnKey;
+
+static uint64_t isbnKey(int64_t isbn){
+    return (uint64_t)isbn ^ 0x8000000000000000ull;
+}
+
+// LSD radix sort through scratch, one byte per pass. All eight byte counts
+// come from a single read, and bytes every key shares are skipped, so real
+// ISBNs take about six passes. Returns whichever of the two arrays ends up sorted.
+static const IsbnKey* sortIsbnKeys(IsbnKey *keys, IsbnKey *scratch, size_t count){
+    static _Thread_local size_t offsets[8][256];
+    memset(offsets, 0, sizeof(offsets));
+    for (size_t i = 0; i < count; i++){
+        for (int byte = 0; byte < 8; byte++) offsets[byte][(keys[i].key >> (8 * byte)) & 0xFF]++;
+    }
+
+    IsbnKey *from = keys, *to = scratch;
+    for (int byte = 0; byte < 8 && count; byte++){
+        size_t *offset = offsets[byte];
+        if (offset[(from[0].key >> (8 * byte)) & 0xFF] == count) continue;
+
+        size_t total = 0;
+        for (int b = 0; b < 256; b++){
+            size_t n = offset[b];
+            offset[b] = total;
+            total += n;
+        }
+        for (size_t i = 0; i < count; i++) to[offset[(from[i].key >> (8 * byte)) & 0xFF]++] = from[i];
+        IsbnKey *swap = from;
+        from = to;
+        to = swap;
+    }
+    return from;
+}
+
+// Keys plus the sort's scratch, in one block; NULL past the u32 record
+// numbers or when memory runs out, and the snapshot then goes without an order
+static IsbnKey* allocIsbnKeys(size_t count){
+    if (count > UINT32_MAX) return NULL;
+    return malloc((count ? count : 1) * 2 * sizeof(IsbnKey));
+}
+
+static int writeRecordNumbers(FILE *fp, const IsbnKey *keys, size_t count){
+    uint32_t chunk[4096];
+    for (size_t i = 0; i < count; i += 4096){
+        size_t n = count - i < 4096 ? count - i : 4096;
+        for (size_t j = 0; j < n; j++) chunk[j] = keys[i + j].record;
+        if (fwrite(chunk, sizeof(uint32_t), n, fp) != n) return 0;
+    }
+    return 1;
+}
+
+// ============= SAVE =============
+
+// Collects the ISBN keys in the same walk when keys is not NULL
+static int writeList(FILE *fp, const BookList *list, IsbnKey *keys, uint32_t *record){
+    SnapshotRecord rec;
+    memset(&rec, 0, sizeof(rec));  // padding bytes stay zero so files are reproducible
+
+    for (const Book *book = list->head; book; book = book->next){
+        if (keys){
+            keys[*record] = (IsbnKey){isbnKey(book->isbn), *record};
+            ++*record;
+        }
+        rec.isbn = book->isbn;
+        rec.rating = book->rating;
+        rec.title = book->title;
+        rec.author = book->author;
+        if (fwrite(&rec, sizeof(rec), 1, fp) != 1) return 0;
+    }
+    return 1;
+}
+
+int saveSnapshot(Library *lib, const char *path){
+    compactStrings(lib, 0);  // the arena is written as it is, dead titles and all
+    char tmp[SNAPSHOT_MAXPATH];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)){
+        printError("Snapshot path is too long.");
+        return 0;
+    }
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp){
+        printError("Cannot open snapshot file for writing.");
+        return 0;
+    }
+    setvbuf(fp, NULL, _IOFBF, SNAPSHOT_IO_BUFFER);
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.record_size = sizeof(SnapshotRecord);
+    hdr.flags = lib->is_split ? SNAPSHOT_SPLIT : 0;
+    hdr.counts[0] = countBooks(&lib->main_list);
+    hdr.bucket_count = (uint32_t)lib->bucket_count;
+    memcpy(hdr.cuts, lib->cuts, sizeof(hdr.cuts));
+    for (int i = 0; i < lib->bucket_count; i++) hdr.bucket_counts[i] = countBooks(&lib->buckets[i]);
+    if (lib->last_added){
+        hdr.flags |= SNAPSHOT_HAS_LAST;
+        hdr.last_added_isbn = lib->last_added->isbn;
+    }
+    hdr.journal_lsn = lib->journal_lsn;
+    hdr.strings_size = lib->strings.used;
+    size_t total = lib->index.count;
+    IsbnKey *keys = allocIsbnKeys(total);
+    if (keys) hdr.flags |= SNAPSHOT_BY_ISBN;
+
+    uint32_t record = 0;
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok = ok && writeList(fp, &lib->main_list, keys, &record);
+    for (int i = 0; ok && i < lib->bucket_count; i++) ok = writeList(fp, &lib->buckets[i], keys, &record);
+    if (ok && hdr.strings_size) ok = fwrite(lib->strings.data, 1, hdr.strings_size, fp) == hdr.strings_size;
+    if (ok && keys){
+        ok = writeRecordNumbers(fp, sortIsbnKeys(keys, keys + total, total), total);
+    }
+    free(keys);
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0) ok = 0;
+
+    // Write-then-rename so a crash never leaves a half-written snapshot behind
+    if (!ok || rename(tmp, path) != 0){
+        remove(tmp);
+        printError("Failed to write snapshot.");
+        return 0;
+    }
+    return 1;
+}
+
+// ============= LOAD =============
+
+// A mapped snapshot whose header, counts and section sizes have checked out
+typedef struct{
+    SnapshotHeader hdr;
+    int legacy;
+    size_t record_size;
+    int buckets;
+    int split;
+    uint64_t counts[1 + MAX_BUCKETS];
+    uint64_t total;
+    const unsigned char *records;
+    const char *strings;
+    const unsigned char *order;  // total u32 record numbers in ISBN order, or NULL
+}SnapshotView;
+
+static int openView(SnapshotView *view, const unsigned char *map, size_t size){
+    // Older headers are a prefix of the current one; widen them with zeroes
+    memset(view, 0, sizeof(*view));
+    const SnapshotHeader *hdr = &view->hdr;
+    memcpy(&view->hdr, map, SNAPSHOT_V1_HEADER);
+
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0){
+        printError("Not a book library snapshot.");
+        return 0;
+    }
+    view->legacy = hdr->version < 3;
+    size_t header_size = hdr->version == 1 ? SNAPSHOT_V1_HEADER :
+                         hdr->version == 2 ? SNAPSHOT_V2_HEADER :
+                         hdr->version == 3 ? SNAPSHOT_V3_HEADER : sizeof(SnapshotHeader);
+    view->record_size = view->legacy ? sizeof(LegacyRecord) : sizeof(SnapshotRecord);
+    if (hdr->version < 1 || hdr->version > SNAPSHOT_VERSION || hdr->record_size != view->record_size ||
+        size < header_size){
+        printError("Unsupported snapshot version.");
+        return 0;
+    }
+    memcpy(&view->hdr, map, header_size);
+
+    // Before v4 there were always two buckets split at SPLIT_RATING
+    uint64_t *counts = view->counts;
+    counts[0] = hdr->counts[0];
+    view->buckets = 2;
+    if (hdr->version < 4){
+        counts[1] = hdr->counts[1];
+        counts[2] = hdr->counts[2];
+    }
+    else{
+        view->buckets = (int)hdr->bucket_count;
+        int ordered = view->buckets >= 2 && view->buckets <= MAX_BUCKETS;
+        for (int i = 0; ordered && i < view->buckets - 1; i++){
+            ordered = hdr->cuts[i] > 0.0f && hdr->cuts[i] <= 5.0f && (i == 0 || hdr->cuts[i] < hdr->cuts[i - 1]);
+        }
+        if (!ordered){
+            printError("Snapshot file is corrupt.");
+            return 0;
+        }
+        memcpy(counts + 1, hdr->bucket_counts, (size_t)view->buckets * sizeof(uint64_t));
+    }
+
+    view->split = (hdr->flags & SNAPSHOT_SPLIT) != 0;
+    if (hdr->strings_size > size - header_size){
+        printError("Snapshot file is truncated.");
+        return 0;
+    }
+    size_t capacity = (size - header_size - hdr->strings_size) / view->record_size;
+    uint64_t total = 0, in_buckets = 0;
+    for (int i = 0; i <= view->buckets; i++){
+        if (counts[i] > capacity - total){
+            printError("Snapshot file is truncated.");
+            return 0;
+        }
+        total += counts[i];
+        if (i) in_buckets += counts[i];
+    }
+    int by_isbn = hdr->version >= 5 && (hdr->flags & SNAPSHOT_BY_ISBN);
+    uint64_t order_size = by_isbn ? total * sizeof(uint32_t) : 0;
+    if (header_size + total * view->record_size + hdr->strings_size + order_size != size ||
+        (view->split ? counts[0] != 0 : in_buckets != 0)){
+        printError("Snapshot file is corrupt.");
+        return 0;
+    }
+    view->total = total;
+    view->records = map + header_size;
+    view->strings = (const char *)view->records + total * view->record_size;
+    if (by_isbn) view->order = (const unsigned char *)view->strings + hdr->strings_size;
+    return 1;
+}
+
+// Lists are numbered in file order: 0 is main, then one per bucket
+static char listChoice(int list){
+    return list ? (char)('a' + list - 1) : 'm';
+}
+
+static int validRecord(const Library *lib, float rating, int list){
+    if (!(rating >= 0.0f && rating <= 5.0f)) return 0;
+    return listForRating(lib, rating) == listChoice(list);
+}
+
+static int restoreFromMap(Library *lib, const unsigned char *map, size_t size){
+    SnapshotView view;
+    if (!openView(&view, map, size)) return 0;
+    const SnapshotHeader *hdr = &view.hdr;
+    uint64_t total = view.total;
+
+    // Build into a scratch library and swap it in only once every record checks out
+    Library *fresh = createLibrary();
+    if (!fresh) return 0;
+    fresh->is_split = view.split;
+    fresh->journal_lsn = hdr->journal_lsn;
+    if (hdr->version >= 4){
+        fresh->bucket_count = view.buckets;
+        memcpy(fresh->cuts, hdr->cuts, sizeof(fresh->cuts));
+    }
+    if (!reserveBooks(fresh, total)){
+        printError("Memory allocation failed!");
+        destroyLibrary(fresh);
+        return 0;
+    }
+
+    // v3 adopts the string section in one copy and links books by offset
+    if (hdr->strings_size && !loadStrings(fresh, view.strings, hdr->strings_size)){
+        printError("Snapshot file is corrupt.");
+        destroyLibrary(fresh);
+        return 0;
+    }
+
+    const unsigned char *records = view.records;
+    for (int i = 0; i <= view.buckets; i++){
+        for (uint64_t n = 0; n < view.counts[i]; n++, records += view.record_size){
+            Book *book = NULL;
+            int64_t isbn;
+            float rating;
+            if (view.legacy){
+                const LegacyRecord *rec = (const LegacyRecord *)records;
+                isbn = rec->isbn;
+                rating = rec->rating;
+                if (validRecord(fresh, rating, i) && memchr(rec->title, '\0', LEGACY_MAXNAME) &&
+                    memchr(rec->author, '\0', LEGACY_MAXNAME)){
+                    book = loadBook(fresh, listChoice(i), rec->title, rec->author, (long)isbn, rating);
+                }
+            }
+            else{
+                const SnapshotRecord *rec = (const SnapshotRecord *)records;
+                isbn = rec->isbn;
+                rating = rec->rating;
+                if (validRecord(fresh, rating, i)){
+                    book = loadBookByOffset(fresh, listChoice(i), (long)isbn, rating, rec->title, rec->author);
+                }
+            }
+
+            if (!book){
+                printError("Snapshot file is corrupt.");
+                destroyLibrary(fresh);
+                return 0;
+            }
+            if ((hdr->flags & SNAPSHOT_HAS_LAST) && isbn == hdr->last_added_isbn){
+                fresh->last_added = book;
+            }
+        }
+    }
+
+    // The attached journal, the top-K setting, the ISBN filter and the lock
+    // belong to lib, not to the loaded contents; the cache refills on its next
+    // query, the filter is rebuilt and saved cursors see a new edit count
+    Library old = *lib;
+    *lib = *fresh;
+    lib->list_edits = old.list_edits + 1;
+    lib->journal = old.journal;
+    old.journal = NULL;
+    lib->top = old.top;
+    old.top = NULL;
+    lib->filter = old.filter;
+    old.filter = NULL;
+    lib->lock = old.lock;
+    old.lock = NULL;
+    topCacheInvalidate(lib->top);
+    isbnFilterReset(lib->filter, &lib->index);
+    clearUndoLog(lib);  // the loaded books are not steps to undo
+    *fresh = old;
+    destroyLibrary(fresh);
+    return 1;
+}
+
+// Read-only private mapping of a whole snapshot; NULL after reporting why
+static unsigned char* mapSnapshot(const char *path, size_t *size){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        printError("Cannot open snapshot file.");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_V1_HEADER){
+        close(fd);
+        printError("Snapshot file is truncated.");
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+    void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED){
+        printError("Cannot map snapshot file.");
+        return NULL;
+    }
+    return map;
+}
+
+int loadSnapshot(Library *lib, const char *path){
+    size_t size;
+    unsigned char *map = mapSnapshot(path, &size);
+    if (!map) return 0;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    int ok = restoreFromMap(lib, map, size);
+    munmap(map, size);
+
+    // A load replaces the whole state, which the journal cannot express as
+    // records, so checkpoint it straight away
+    if (ok && lib->journal) ok = compactJournal(lib);
+    return ok;
+}
+
+// ============= DIFF AND MERGE =============
+
+// One book as a snapshot or a diff line holds it
+typedef struct{
+    int64_t isbn;
+    float rating;
+    const char *title;
+    const char *author;
+}SnapshotBook;
+
+// Walks a view in ISBN order, through its order section or, for files saved
+// before v5, through keys sorted here; have drops to 0 past the last book
+typedef struct{
+    const SnapshotView *view;
+    IsbnKey *keys;
+    const IsbnKey *sorted;  // inside keys
+    uint64_t next;
+    int have;
+    uint32_t record;        // where book came from
+    SnapshotBook book;
+}IsbnCursor;
+
+static int readRecord(const SnapshotView *view, uint32_t record, SnapshotBook *book){
+    const unsigned char *raw = view->records + (size_t)record * view->record_size;
+    if (view->legacy){
+        const LegacyRecord *rec = (const LegacyRecord *)raw;
+        if (!memchr(rec->title, '\0', LEGACY_MAXNAME) || !memchr(rec->author, '\0', LEGACY_MAXNAME)) return 0;
+        *book = (SnapshotBook){rec->isbn, rec->rating, rec->title, rec->author};
+    }
+    else{
+        const SnapshotRecord *rec = (const SnapshotRecord *)raw;
+        if (rec->title >= view->hdr.strings_size || !rec->author || rec->author >= view->hdr.strings_size) return 0;
+        *book = (SnapshotBook){rec->isbn, rec->rating, view->strings + rec->title, view->strings + rec->author};
+    }
+    return book->rating >= 0.0f && book->rating <= 5.0f;
+}
+
+// 0 after reporting why; advanceCursor then loads the first book
+static int openCursor(IsbnCursor *cursor, const SnapshotView *view){
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->view = view;
+    // As for loadStrings: every offset must land on a terminated string
+    size_t strings_size = view->legacy ? 0 : view->hdr.strings_size;
+    if ((strings_size && (view->strings[0] != '\0' || view->strings[strings_size - 1] != '\0')) ||
+        view->total > UINT32_MAX){
+        printError("Snapshot file is corrupt.");
+        return 0;
+    }
+    if (!view->order){
+        cursor->keys = allocIsbnKeys(view->total);
+        if (!cursor->keys){
+            printError("Memory allocation failed!");
+            return 0;
+        }
+        for (uint32_t r = 0; r < view->total; r++){
+            int64_t isbn;
+            memcpy(&isbn, view->records + (size_t)r * view->record_size, sizeof(isbn));  // both layouts lead with it
+            cursor->keys[r] = (IsbnKey){isbnKey(isbn), r};
+        }
+        cursor->sorted = sortIsbnKeys(cursor->keys, cursor->keys + view->total, view->total);
+    }
+    return 1;
+}
+
+static void closeCursor(IsbnCursor *cursor){
+    free(cursor->keys);
+    cursor->keys = NULL;
+}
+
+// Loads the next book; ISBNs must rise strictly, which also proves the
+// order section names every record exactly once
+static int advanceCursor(IsbnCursor *cursor){
+    const SnapshotView *view = cursor->view;
+    if (cursor->next == view->total){
+        cursor->have = 0;
+        return 1;
+    }
+    uint32_t record;
+    if (cursor->keys) record = cursor->sorted[cursor->next].record;
+    else memcpy(&record, view->order + cursor->next * sizeof(uint32_t), sizeof(record));
+
+    int64_t previous = cursor->book.isbn;
+    if (record >= view->total || !readRecord(view, record, &cursor->book) ||
+        (cursor->next && cursor->book.isbn <= previous)){
+        printError("Snapshot file is corrupt.");
+        return 0;
+    }
+    cursor->next++;
+    cursor->have = 1;
+    cursor->record = record;
+    return 1;
+}
+
+// Tabs and line breaks inside names would split a diff line
+static void writeEscaped(FILE *out, const char *text){
+    for (;;){
+        size_t run = strcspn(text, "\\\t\n\r");
+        fwrite(text, 1, run, out);
+        text += run;
+        if (!*text) return;
+        fputc('\\', out);
+        fputc(*text == '\t' ? 't' : *text == '\n' ? 'n' : *text == '\r' ? 'r' : '\\', out);
+        text++;
+    }
+}
+
+// Undoes writeEscaped in place; 0 on a stray backslash
+static int unescape(char *text){
+    char *to = text;
+    for (const char *from = text; *from; from++){
+        if (*from != '\\'){
+            *to++ = *from;
+            continue;
+        }
+        from++;
+        if (*from == 't') *to++ = '\t';
+        else if (*from == 'n') *to++ = '\n';
+        else if (*from == 'r') *to++ = '\r';
+        else if (*from == '\\') *to++ = '\\';
+        else return 0;
+    }
+    *to = '\0';
+    return 1;
+}
+
+// The shortest of %g and %.9g that reads back as the same float
+static void writeDiffBook(FILE *out, char op, const SnapshotBook *book){
+    char rating[32];
+    snprintf(rating, sizeof(rating), "%g", book->rating);
+    if (strtof(rating, NULL) != book->rating) snprintf(rating, sizeof(rating), "%.9g", book->rating);
+
+    fprintf(out, "%c\t%lld", op, (long long)book->isbn);
+    if (op != '-'){
+        fprintf(out, "\t%s\t", rating);
+        writeEscaped(out, book->title);
+        fputc('\t', out);
+        writeEscaped(out, book->author);
+    }
+    fputc('\n', out);
+}
+
+static int sameBook(const SnapshotBook *a, const SnapshotBook *b){
+    return a->rating == b->rating && strcmp(a->title, b->title) == 0 && strcmp(a->author, b->author) == 0;
+}
+
+int diffSnapshots(const char *old_path, const char *new_path, FILE *out, SnapshotDiffStats *stats){
+    SnapshotDiffStats counts = {0};
+    size_t old_size, new_size;
+    unsigned char *old_map = mapSnapshot(old_path, &old_size);
+    if (!old_map) return 0;
+    unsigned char *new_map = mapSnapshot(new_path, &new_size);
+    if (!new_map){
+        munmap(old_map, old_size);
+        return 0;
+    }
+
+    SnapshotView old_view, new_view;
+    IsbnCursor a = {0}, b = {0};
+    int ok = openView(&old_view, old_map, old_size) && openView(&new_view, new_map, new_size) &&
+             openCursor(&a, &old_view) && openCursor(&b, &new_view) &&
+             advanceCursor(&a) && advanceCursor(&b);
+    if (ok) fprintf(out, "%s\n", SNAPSHOT_DIFF_HEADER);
+
+    // Merge join: whichever side holds the lower ISBN moves on
+    while (ok && (a.have || b.have)){
+        if (!b.have || (a.have && a.book.isbn < b.book.isbn)){
+            writeDiffBook(out, '-', &a.book);
+            counts.removed++;
+            ok = advanceCursor(&a);
+        }
+        else if (!a.have || b.book.isbn < a.book.isbn){
+            writeDiffBook(out, '+', &b.book);
+            counts.added++;
+            ok = advanceCursor(&b);
+        }
+        else{
+            if (sameBook(&a.book, &b.book)) counts.unchanged++;
+            else{
+                writeDiffBook(out, '~', &b.book);
+                counts.changed++;
+            }
+            ok = advanceCursor(&a) && advanceCursor(&b);
+        }
+    }
+    if (ok && (fflush(out) != 0 || ferror(out))){
+        printError("Failed to write the diff.");
+        ok = 0;
+    }
+
+    closeCursor(&a);
+    closeCursor(&b);
+    munmap(old_map, old_size);
+    munmap(new_map, new_size);
+    if (ok && stats) *stats = counts;
+    return ok;
+}
+
+// One parsed diff line; the names point into the line buffer
+typedef struct{
+    char op;          // '+', '-' or '~'
+    SnapshotBook book;
+}DiffEntry;
+
+// Reads a diff one change at a time; have drops to 0 at its end
+typedef struct{
+    FILE *fp;
+    char *line;
+    size_t cap;
+    size_t line_no;
+    int have;
+    DiffEntry entry;
+}DiffReader;
+
+static int parseDiffLine(char *line, DiffEntry *entry){
+    line[strcspn(line, "\r\n")] = '\0';
+    char *fields[5] = {line};
+    int n = 1;
+    for (char *tab = strchr(line, '\t'); tab && n < 5; tab = strchr(tab + 1, '\t')){
+        *tab = '\0';
+        fields[n++] = tab + 1;
+    }
+    if (strlen(fields[0]) != 1 || !strchr("+-~", fields[0][0])) return 0;
+    entry->op = fields[0][0];
+    if (n != (entry->op == '-' ? 2 : 5) || (n == 5 && strchr(fields[4], '\t'))) return 0;
+
+    char *end;
+    entry->book.isbn = strtoll(fields[1], &end, 10);
+    if (end == fields[1] || *end) return 0;
+    if (entry->op == '-') return 1;
+
+    entry->book.rating = strtof(fields[2], &end);
+    if (end == fields[2] || *end || !(entry->book.rating >= 0.0f && entry->book.rating <= 5.0f)) return 0;
+    if (!unescape(fields[3]) || !unescape(fields[4])) return 0;
+    entry->book.title = fields[3];
+    entry->book.author = fields[4];
+    return 1;
+}
+
+// Reads the next change, skipping blank and # lines; 0 after reporting a bad one
+static int advanceDiff(DiffReader *reader){
+    int64_t previous = reader->entry.book.isbn;
+    int first = !reader->have;
+    do{
+        if (getline(&reader->line, &reader->cap, reader->fp) < 0){
+            reader->have = 0;
+            if (!ferror(reader->fp)) return 1;
+            printError("Cannot read the diff.");
+            return 0;
+        }
+        reader->line_no++;
+    }while (strchr("#\r\n", reader->line[0]));
+
+    if (!parseDiffLine(reader->line, &reader->entry)){
+        printError("Diff line %zu is malformed.", reader->line_no);
+        return 0;
+    }
+    if (!first && reader->entry.book.isbn <= previous){
+        printError("Diff line %zu is out of ISBN order.", reader->line_no);
+        return 0;
+    }
+    reader->have = 1;
+    return 1;
+}
+
+// Streams a merged snapshot. Its string section starts with the base's,
+// copied as it is, so books carried over (and changed ones that keep a name)
+// keep their offsets; only new names collect in a temporary file, appended
+// at the end with the base's strings in front.
+typedef struct{
+    FILE *fp;
+    FILE *strings;
+    const SnapshotView *base;
+    uint64_t base_strings;    // bytes of the base's section reused; 0 for inline-string files
+    uint64_t strings_size;
+    uint64_t count;
+}MergedWriter;
+
+static int appendString(MergedWriter *w, const char *text, uint32_t *offset){
+    size_t len = strlen(text) + 1;
+    if (w->strings_size + len > UINT32_MAX) return 0;  // offsets are 32-bit
+    *offset = (uint32_t)w->strings_size;
+    w->strings_size += len;
+    return fwrite(text, 1, len, w->strings) == len;
+}
+
+static int placeString(MergedWriter *w, const char *text, uint32_t base_offset, uint32_t *offset){
+    const char *old = w->base->strings + base_offset;
+    if (w->base_strings && (text == old || strcmp(text, old) == 0)){
+        *offset = base_offset;
+        return 1;
+    }
+    return appendString(w, text, offset);
+}
+
+// from is the base record the book replaces or carries over, or NULL
+static int writeMergedBook(MergedWriter *w, const SnapshotBook *book, const SnapshotRecord *from){
+    SnapshotRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.isbn = book->isbn;
+    rec.rating = book->rating;
+    int placed = from ? placeString(w, book->title, from->title, &rec.title) &&
+                        placeString(w, book->author, from->author, &rec.author) :
+                        appendString(w, book->title, &rec.title) && appendString(w, book->author, &rec.author);
+    if (!placed) return 0;
+    w->count++;
+    return fwrite(&rec, sizeof(rec), 1, w->fp) == 1;
+}
+
+static const SnapshotRecord* baseRecord(const IsbnCursor *base){
+    if (base->view->legacy) return NULL;
+    return (const SnapshotRecord *)(base->view->records + (size_t)base->record * base->view->record_size);
+}
+
+// Strings, then the order section (the records are already in ISBN order),
+// then the real header over the placeholder
+static int finishMerged(MergedWriter *w){
+    const SnapshotView *base = w->base;
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.record_size = sizeof(SnapshotRecord);
+    hdr.flags = SNAPSHOT_BY_ISBN;
+    hdr.counts[0] = w->count;
+    hdr.strings_size = w->strings_size;
+    hdr.bucket_count = 2;
+    hdr.cuts[0] = SPLIT_RATING;
+    if (base->hdr.version >= 4){
+        hdr.bucket_count = base->hdr.bucket_count;
+        memcpy(hdr.cuts, base->hdr.cuts, sizeof(hdr.cuts));
+    }
+
+    char chunk[1 << 16];
+    size_t n;
+    int ok = fwrite(base->strings, 1, w->base_strings, w->fp) == w->base_strings;
+    ok = ok && fflush(w->strings) == 0 && fseek(w->strings, 0, SEEK_SET) == 0;
+    while (ok && (n = fread(chunk, 1, sizeof(chunk), w->strings)) > 0) ok = fwrite(chunk, 1, n, w->fp) == n;
+    ok = ok && !ferror(w->strings);
+
+    uint32_t order[4096];
+    for (uint64_t i = 0; ok && i < w->count; i += 4096){
+        size_t len = w->count - i < 4096 ? (size_t)(w->count - i) : 4096;
+        for (size_t j = 0; j < len; j++) order[j] = (uint32_t)(i + j);
+        ok = fwrite(order, sizeof(uint32_t), len, w->fp) == len;
+    }
+    ok = ok && fseek(w->fp, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, w->fp) == 1;
+    return ok && fflush(w->fp) == 0 && fsync(fileno(w->fp)) == 0;
+}
+
+// Merge join of the base in ISBN order with the diff, which is in ISBN order too
+static int mergeDiff(IsbnCursor *base, DiffReader *diff, MergedWriter *w, SnapshotDiffStats *counts){
+    while (base->have || diff->have){
+        if (!diff->have || (base->have && base->book.isbn < diff->entry.book.isbn)){
+            if (!writeMergedBook(w, &base->book, baseRecord(base))) return -1;
+            counts->unchanged++;
+            if (!advanceCursor(base)) return 0;
+            continue;
+        }
+
+        const DiffEntry *entry = &diff->entry;
+        int in_base = base->have && base->book.isbn == entry->book.isbn;
+        if (in_base == (entry->op == '+')){
+            printError(in_base ? "Diff line %zu adds ISBN %lld, which the base already has." :
+                                 "Diff line %zu names ISBN %lld, which the base does not have.",
+                       diff->line_no, (long long)entry->book.isbn);
+            return 0;
+        }
+        if (entry->op != '-' && !writeMergedBook(w, &entry->book, in_base ? baseRecord(base) : NULL)) return -1;
+        if (entry->op == '+') counts->added++;
+        else if (entry->op == '-') counts->removed++;
+        else counts->changed++;
+        if ((in_base && !advanceCursor(base)) || !advanceDiff(diff)) return 0;
+    }
+    return 1;
+}
+
+int applySnapshotDiff(const char *base_path, FILE *diff, const char *out_path, SnapshotDiffStats *stats){
+    char tmp[SNAPSHOT_MAXPATH];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", out_path) >= (int)sizeof(tmp)){
+        printError("Snapshot path is too long.");
+        return 0;
+    }
+    size_t size;
+    unsigned char *map = mapSnapshot(base_path, &size);
+    if (!map) return 0;
+
+    SnapshotView view;
+    IsbnCursor base = {0};
+    DiffReader reader = {diff, NULL, 0, 0, 0, {0}};
+    SnapshotDiffStats counts = {0};
+    MergedWriter w = {NULL, NULL, &view, 0, 0, 0};
+    int ok = openView(&view, map, size) && openCursor(&base, &view);
+    if (ok){
+        w.fp = fopen(tmp, "wb");
+        w.strings = tmpfile();
+        if (!w.fp || !w.strings){
+            printError("Cannot open snapshot file for writing.");
+            ok = 0;
+        }
+    }
+    if (ok){
+        setvbuf(w.fp, NULL, _IOFBF, SNAPSHOT_IO_BUFFER);
+        // The header is rewritten once the counts are known. A string
+        // section must open with a NUL; without the base's, the new one does.
+        SnapshotHeader placeholder;
+        memset(&placeholder, 0, sizeof(placeholder));
+        int written = fwrite(&placeholder, sizeof(placeholder), 1, w.fp) == 1;
+        if (!view.legacy && view.hdr.strings_size) w.base_strings = view.hdr.strings_size;
+        else written = written && fputc('\0', w.strings) != EOF;
+        w.strings_size = w.base_strings ? w.base_strings : 1;
+
+        int merged = written && advanceCursor(&base) && advanceDiff(&reader) ? mergeDiff(&base, &reader, &w, &counts) : 0;
+        if (!written || merged < 0 || (merged > 0 && !finishMerged(&w))){
+            printError("Failed to write snapshot.");
+            merged = 0;
+        }
+        ok = merged > 0;
+    }
+
+    if (w.strings) fclose(w.strings);
+    int closed = !w.fp || fclose(w.fp) == 0;
+    // Write-then-rename, as for a save
+    if (w.fp && (!ok || !closed || rename(tmp, out_path) != 0)){
+        remove(tmp);
+        if (ok) printError("Failed to write snapshot.");
+        ok = 0;
+    }
+    free(reader.line);
+    closeCursor(&base);
+    munmap(map, size);
+    if (ok && stats) *stats = counts;
+    return ok;
+}
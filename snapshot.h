@@ -0,0 +1,42 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "book.h"
+
+// Binary snapshots: fixed-width records and a string section behind a versioned header.
+// Both return 1 on success and 0 on failure; a failed load leaves lib untouched.
+int saveSnapshot(Library *lib, const char *path);
+int loadSnapshot(Library *lib, const char *path);
+
+// Snapshot diffs, computed and applied without loading either library.
+// Snapshots since v5 list their records in ISBN order, so both run as a merge
+// join over the mapped files in O(n + m) time and constant extra memory;
+// older files are first sorted in memory, at 32 bytes per book.
+//
+// A diff is text, one change per line in ascending ISBN order, fields split
+// by tabs; names escape backslash, tab and line breaks as \\, \t, \n and \r:
+//   + isbn rating title author    in the new snapshot only
+//   - isbn                        in the old snapshot only
+//   ~ isbn rating title author    in both, with a new rating, title or author
+// Blank lines and lines starting with # are ignored.
+#define SNAPSHOT_DIFF_HEADER "# book snapshot diff"
+
+typedef struct{
+    uint64_t added;
+    uint64_t removed;
+    uint64_t changed;
+    uint64_t unchanged;  // when applying: base books carried over as they were
+}SnapshotDiffStats;
+
+// Writes the changes from old_path to new_path; stats may be NULL
+int diffSnapshots(const char *old_path, const char *new_path, FILE *out, SnapshotDiffStats *stats);
+
+// Writes base_path with diff applied to out_path as an unsplit v5 snapshot in
+// ISBN order, keeping the base's bucket cuts. Fails, leaving out_path alone,
+// on a diff out of ISBN order, an added ISBN the base already has, or a
+// removed or changed one it lacks.
+int applySnapshotDiff(const char *base_path, FILE *diff, const char *out_path, SnapshotDiffStats *stats);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "stats.h"
+
+static const char *const opNames[STAT_OPS] = {
+    "add", "load", "find", "lookup", "delete", "delete-last",
+    "sort", "split", "merge", "free", "buckets", "range", "search", "top", "undo", "defrag"
+};
+
+const char* statOpName(StatOp op){
+    return op < STAT_OPS ? opNames[op] : "unknown";
+}
+
+uint64_t statPercentile(const OpStats *stats, double p){
+    uint64_t target = (uint64_t)(p * (double)stats->timed), seen = 0;
+    for (int b = 0; b < STAT_BUCKETS_LOG2; b++){
+        seen += stats->histogram[b];
+        if (seen > target) return b < 63 && ((uint64_t)1 << b) < stats->max_ns ? (uint64_t)1 << b : stats->max_ns;
+    }
+    return stats->max_ns;
+}
+
+#ifdef BOOK_NO_STATS
+
+int statsEnabled(void){
+    return 0;
+}
+
+void readOpStats(StatOp op, OpStats *stats){
+    (void)op;
+    *stats = (OpStats){0};
+}
+
+void resetStats(void){
+}
+
+void writeStatsJson(FILE *out){
+    fputs("{\"enabled\":false}\n", out);
+}
+
+#else
+
+// One block per thread, never freed, so counts outlive the threads that made
+// them. Only the owning thread writes a block; the relaxed atomics let other
+// threads read it without a data race and compile to plain loads and stores.
+typedef struct{
+    _Atomic uint64_t calls;
+    _Atomic uint64_t timed;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t histogram[STAT_BUCKETS_LOG2];
+}OpCounters;
+
+typedef struct StatsBlock{
+    OpCounters ops[STAT_OPS];
+    struct StatsBlock *next;
+}StatsBlock;
+
+static _Atomic(StatsBlock *) blocks;                // every thread's block
+static _Thread_local StatsBlock *threadBlock;
+static _Thread_local int currentOp = -1;  // bytes allocated now are charged here
+
+// Per-book operations are sampled; a list-wide one is timed on every call
+static const uint64_t sampleMask[STAT_OPS] = {
+    [STAT_ADD] = STATS_SAMPLE_EVERY - 1, [STAT_LOAD] = STATS_SAMPLE_EVERY - 1,
+    [STAT_FIND] = STATS_SAMPLE_EVERY - 1, [STAT_LOOKUP] = STATS_SAMPLE_EVERY - 1,
+    [STAT_DELETE] = STATS_SAMPLE_EVERY - 1, [STAT_DELETE_LAST] = STATS_SAMPLE_EVERY - 1
+};
+
+// CLOCK_MONOTONIC is read through the vDSO, so no system call per sample
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int bucketOf(uint64_t ns){
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;  // ns < 2^bucket
+    return bucket < STAT_BUCKETS_LOG2 ? bucket : STAT_BUCKETS_LOG2 - 1;
+}
+
+// Owner-only update: a relaxed load and store, no locked instruction
+static void bump(_Atomic uint64_t *counter, uint64_t by){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + by, memory_order_relaxed);
+}
+
+// NULL only when the first call on a thread cannot allocate; that thread then goes uncounted
+static StatsBlock* myBlock(void){
+    if (threadBlock) return threadBlock;
+    StatsBlock *block = calloc(1, sizeof(StatsBlock));
+    if (!block) return NULL;
+    block->next = atomic_load_explicit(&blocks, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&blocks, &block->next, block,
+                                                  memory_order_release, memory_order_relaxed));
+    threadBlock = block;
+    return block;
+}
+
+int statsEnabled(void){
+    return 1;
+}
+
+StatsTimer statsStart(StatOp op){
+    StatsTimer timer = {op, currentOp, 0, 0};
+    StatsBlock *block = myBlock();
+    currentOp = op;
+    if (!block) return timer;
+
+    OpCounters *c = &block->ops[op];
+    uint64_t calls = atomic_load_explicit(&c->calls, memory_order_relaxed);
+    atomic_store_explicit(&c->calls, calls + 1, memory_order_relaxed);
+    if (!(calls & sampleMask[op])){
+        timer.timed = 1;
+        timer.start_ns = nowNs();
+    }
+    return timer;
+}
+
+void statsStop(StatsTimer *timer){
+    currentOp = timer->outer;
+    if (!timer->timed) return;
+
+    uint64_t ns = nowNs() - timer->start_ns;
+    OpCounters *c = &threadBlock->ops[timer->op];
+    bump(&c->timed, 1);
+    bump(&c->total_ns, ns);
+    bump(&c->histogram[bucketOf(ns)], 1);
+    if (ns > atomic_load_explicit(&c->max_ns, memory_order_relaxed)){
+        atomic_store_explicit(&c->max_ns, ns, memory_order_relaxed);
+    }
+}
+
+void statsBytes(size_t bytes){
+    if (currentOp >= 0 && threadBlock) bump(&threadBlock->ops[currentOp].bytes, bytes);
+}
+
+void readOpStats(StatOp op, OpStats *stats){
+    *stats = (OpStats){0};
+    for (StatsBlock *block = atomic_load_explicit(&blocks, memory_order_acquire); block; block = block->next){
+        OpCounters *c = &block->ops[op];
+        stats->calls += atomic_load_explicit(&c->calls, memory_order_relaxed);
+        stats->timed += atomic_load_explicit(&c->timed, memory_order_relaxed);
+        stats->total_ns += atomic_load_explicit(&c->total_ns, memory_order_relaxed);
+        stats->bytes += atomic_load_explicit(&c->bytes, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&c->max_ns, memory_order_relaxed);
+        if (max > stats->max_ns) stats->max_ns = max;
+        for (int b = 0; b < STAT_BUCKETS_LOG2; b++){
+            stats->histogram[b] += atomic_load_explicit(&c->histogram[b], memory_order_relaxed);
+        }
+    }
+}
+
+// Counts from calls running during the reset may survive it
+void resetStats(void){
+    for (StatsBlock *block = atomic_load_explicit(&blocks, memory_order_acquire); block; block = block->next){
+        for (int op = 0; op < STAT_OPS; op++){
+            OpCounters *c = &block->ops[op];
+            atomic_store_explicit(&c->calls, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->timed, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->total_ns, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->max_ns, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->bytes, 0, memory_order_relaxed);
+            for (int b = 0; b < STAT_BUCKETS_LOG2; b++) atomic_store_explicit(&c->histogram[b], 0, memory_order_relaxed);
+        }
+    }
+}
+
+// Histograms are written sparsely as [bucket, count] pairs
+void writeStatsJson(FILE *out){
+    fprintf(out, "{\"enabled\":true,\"unit\":\"ns\",\"sample_every\":%d,\"operations\":{", STATS_SAMPLE_EVERY);
+    int first = 1;
+    for (int op = 0; op < STAT_OPS; op++){
+        OpStats s;
+        readOpStats((StatOp)op, &s);
+        if (!s.calls) continue;
+        fprintf(out, "%s\"%s\":{\"calls\":%llu,\"timed\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,\"bytes\":%llu,\"log2_histogram\":[",
+                first ? "" : ",", opNames[op], (unsigned long long)s.calls, (unsigned long long)s.timed,
+                (unsigned long long)s.total_ns, (unsigned long long)s.max_ns, (unsigned long long)s.bytes);
+        int first_bucket = 1;
+        for (int b = 0; b < STAT_BUCKETS_LOG2; b++){
+            if (!s.histogram[b]) continue;
+            fprintf(out, "%s[%d,%llu]", first_bucket ? "" : ",", b, (unsigned long long)s.histogram[b]);
+            first_bucket = 0;
+        }
+        fputs("]}", out);
+        first = 0;
+    }
+    fputs("}}\n", out);
+}
+
+#endif // BOOK_NO_STATS
@@ -0,0 +1,84 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Per-operation instrumentation of the book.c core: call counts, total and
+// maximum latency, a log2 latency histogram and the bytes each operation
+// allocated. Every thread counts into its own block, so the hooks take no
+// locks and share no cache lines; reads add the blocks up. Every call is
+// counted, but the per-book operations (add, load, find, lookup, delete) are
+// timed on one call in STATS_SAMPLE_EVERY, which keeps the clock off most of
+// a bulk load; the list-wide ones are timed every time.
+// Building with -DBOOK_NO_STATS turns the hooks below into nothing.
+
+typedef enum{
+    STAT_ADD,
+    STAT_LOAD,         // bulk inserts from snapshots, imports and journal replay
+    STAT_FIND,
+    STAT_LOOKUP,
+    STAT_DELETE,
+    STAT_DELETE_LAST,
+    STAT_SORT,
+    STAT_SPLIT,
+    STAT_MERGE,
+    STAT_FREE,
+    STAT_BUCKETS,
+    STAT_RANGE,
+    STAT_SEARCH,       // title/author queries, building the index included
+    STAT_TOP,          // top/bottom K queries and setting up the cache
+    STAT_UNDO,
+    STAT_DEFRAG,
+    STAT_OPS
+}StatOp;
+
+#define STAT_BUCKETS_LOG2  64  // histogram bucket b counts calls under 2^b ns
+#define STATS_SAMPLE_EVERY 16  // power of two
+
+// A snapshot of one operation's counters
+typedef struct{
+    uint64_t calls;
+    uint64_t timed;     // calls that were sampled; total_ns and the histogram cover these
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t bytes;
+    uint64_t histogram[STAT_BUCKETS_LOG2];
+}OpStats;
+
+#ifdef BOOK_NO_STATS
+
+#define STATS_SCOPE(op)  ((void)0)
+#define STATS_BYTES(n)   ((void)0)
+
+#else
+
+typedef struct{
+    int op;
+    int outer;         // operation running when this one started, or -1
+    int timed;
+    uint64_t start_ns;
+}StatsTimer;
+
+StatsTimer statsStart(StatOp op);
+void statsStop(StatsTimer *timer);
+void statsBytes(size_t bytes);
+
+// Counts a call and times the rest of the enclosing block, whichever way it is left
+#define STATS_SCOPE(op) StatsTimer statsTimer __attribute__((cleanup(statsStop))) = statsStart(op)
+// Charges an allocation to the operation running on this thread
+#define STATS_BYTES(n)  statsBytes(n)
+
+#endif // BOOK_NO_STATS
+
+// 0 when compiled out; the functions below then report nothing
+int statsEnabled(void);
+const char* statOpName(StatOp op);
+void readOpStats(StatOp op, OpStats *stats);
+uint64_t statPercentile(const OpStats *stats, double p);  // of the timed calls: bucket upper bound, at most max_ns
+void resetStats(void);
+
+// Machine-readable dump: one JSON object with every operation that ran
+void writeStatsJson(FILE *out);
+
+#endif // STATS_H
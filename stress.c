@@ -0,0 +1,206 @@
+// Reader scaling stress test for shared libraries. One writer keeps adding and
+// deleting books while 1, 2, 4, ... reader threads look books up, read counts
+// and averages and walk the lists. Prints read throughput per reader count and
+// fails if a reader ever sees a wrong or missing book.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "book.h"
+#include "parallel.h"
+#include "shared.h"
+
+#define STRESS_BASE_ISBN  1000000000L
+#define STRESS_CHURN      4096   // ISBNs the writer cycles through
+#define STRESS_WALK_NODES 256    // nodes per list walk
+#define STRESS_BATCH      64     // reads between checks of the stop flag
+
+typedef struct{
+    long books;
+    double seconds;
+    int max_readers;
+    long write_pause_us;
+}StressOptions;
+
+typedef struct{
+    Library *lib;
+    const StressOptions *opts;
+    atomic_int *stop;
+    unsigned seed;
+    unsigned long long reads;
+    unsigned long long errors;
+}Reader;
+
+typedef struct{
+    Library *lib;
+    const StressOptions *opts;
+    atomic_int *stop;
+    unsigned long long writes;
+}Writer;
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned nextRandom(unsigned *state){
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+static float ratingFor(long isbn){
+    return (float)(isbn % 51) / 10.0f;
+}
+
+// Mostly ISBN lookups of books the writer never touches, so each one must be
+// found; every so often a count/average read or a short list walk
+static int readOnce(Reader *r){
+    Library *lib = r->lib;
+    unsigned pick = nextRandom(&r->seed);
+    int ok = 1;
+
+    beginRead(lib);
+    if (pick % 16 == 0){
+        double avg = averageRating(&lib->main_list);
+        ok = countBooks(&lib->main_list) >= (size_t)r->opts->books && avg >= 0.0 && avg <= 5.0;
+    }
+    else if (pick % 64 == 1){
+        Book *temp = lib->main_list.head;
+        for (int i = 0; temp && i < STRESS_WALK_NODES; i++) temp = temp->next;
+    }
+    else{
+        long isbn = STRESS_BASE_ISBN + (long)(pick % (unsigned)r->opts->books);
+        Book *book = findBook(lib, 'm', isbn);
+        ok = book && book->isbn == isbn && book->rating == ratingFor(isbn);
+    }
+    endAccess(lib);
+    return ok;
+}
+
+static void* readerMain(void *arg){
+    Reader *r = arg;
+    while (!atomic_load_explicit(r->stop, memory_order_relaxed)){
+        for (int i = 0; i < STRESS_BATCH; i++){
+            if (!readOnce(r)) r->errors++;
+        }
+        r->reads += STRESS_BATCH;
+    }
+    return NULL;
+}
+
+// Cycles a window of ISBNs above the readers' range: add while absent, delete while present
+static void* writerMain(void *arg){
+    Writer *w = arg;
+    long churn_base = STRESS_BASE_ISBN + w->opts->books;
+    struct timespec pause = {0, w->opts->write_pause_us * 1000L};
+    unsigned long long step = 0;
+
+    while (!atomic_load_explicit(w->stop, memory_order_relaxed)){
+        long isbn = churn_base + (long)(step % STRESS_CHURN);
+        beginWrite(w->lib);
+        if (lookupBook(w->lib, isbn)) deleteBookByISBN(w->lib, 'm', isbn);
+        else addBook(w->lib, "Churn", "Writer", isbn, ratingFor(isbn));
+        endAccess(w->lib);
+        w->writes++;
+        step++;
+        if (pause.tv_nsec) nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// One timed round with the given number of readers; returns 0 on a bad read
+static int runRound(Library *lib, const StressOptions *opts, int readers){
+    atomic_int stop = 0;
+    Reader *r = calloc((size_t)readers, sizeof(Reader));
+    pthread_t *threads = malloc((size_t)readers * sizeof(pthread_t));
+    if (!r || !threads){
+        fprintf(stderr, "Memory allocation failed!\n");
+        free(r);
+        free(threads);
+        return 0;
+    }
+
+    Writer w = {lib, opts, &stop, 0};
+    pthread_t writer;
+    pthread_create(&writer, NULL, writerMain, &w);
+    double start = now();
+    for (int i = 0; i < readers; i++){
+        r[i] = (Reader){lib, opts, &stop, 0x9E3779B9u * (unsigned)(i + 1), 0, 0};
+        pthread_create(&threads[i], NULL, readerMain, &r[i]);
+    }
+
+    struct timespec run = {(time_t)opts->seconds, (long)((opts->seconds - (double)(time_t)opts->seconds) * 1e9)};
+    nanosleep(&run, NULL);
+    atomic_store(&stop, 1);
+
+    unsigned long long reads = 0, errors = 0;
+    for (int i = 0; i < readers; i++){
+        pthread_join(threads[i], NULL);
+        reads += r[i].reads;
+        errors += r[i].errors;
+    }
+    pthread_join(writer, NULL);
+    double elapsed = now() - start;
+
+    printf("%7d  %12.0f  %12.0f  %10.0f  %llu\n", readers, (double)reads / elapsed,
+           (double)reads / elapsed / readers, (double)w.writes / elapsed, errors);
+    fflush(stdout);
+    free(r);
+    free(threads);
+    return errors == 0;
+}
+
+static int parseOptions(int argc, char *argv[], StressOptions *opts){
+    opts->books = 200000;
+    opts->seconds = 2.0;
+    opts->max_readers = onlineCpus() * 2;
+    opts->write_pause_us = 100;
+
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc) return 0;
+        if (strcmp(argv[i], "--books") == 0) opts->books = atol(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0) opts->seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-readers") == 0) opts->max_readers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--write-pause-us") == 0) opts->write_pause_us = atol(argv[++i]);
+        else return 0;
+    }
+    return opts->books > 0 && opts->seconds > 0.0 && opts->max_readers > 0 &&
+           opts->write_pause_us >= 0 && opts->write_pause_us < 1000000;
+}
+
+int main(int argc, char *argv[]){
+    StressOptions opts;
+    if (!parseOptions(argc, argv, &opts)){
+        fprintf(stderr, "Usage: %s [--books n] [--seconds s] [--max-readers n] [--write-pause-us us]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Library *lib = createLibrary();
+    if (!lib || !reserveBooks(lib, (size_t)opts.books + STRESS_CHURN) || !enableSharedAccess(lib)){
+        fprintf(stderr, "Failed to set up the library.\n");
+        destroyLibrary(lib);
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < opts.books; i++){
+        long isbn = STRESS_BASE_ISBN + i;
+        if (addBook(lib, "Stress", "Reader", isbn, ratingFor(isbn)) != BOOK_OK){
+            fprintf(stderr, "Failed to add book %ld.\n", isbn);
+            destroyLibrary(lib);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%ld books, %.1f s per round, writer pause %ld us, %d CPUs\n",
+           opts.books, opts.seconds, opts.write_pause_us, onlineCpus());
+    printf("readers     reads/sec    per reader  writes/sec  errors\n");
+    int ok = 1;
+    for (int readers = 1; readers <= opts.max_readers; readers *= 2){
+        if (!runRound(lib, &opts, readers)) ok = 0;
+    }
+
+    destroyLibrary(lib);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include "topk.h"
+#include "stats.h"
+
+// The cache holds k books plus slack, so a delete from the top k can usually
+// be answered by the next book in line. Only once the slack is used up does
+// the following query pay for a fresh O(n log k) pass.
+#define TOP_CACHE_MIN_SLACK 16
+
+struct TopCache{
+    Book **books;      // best first
+    size_t count;
+    size_t allocated;
+    size_t k;          // queries up to this size are served from books
+    size_t capacity;   // k plus slack
+    int complete;      // books holds every book in the library
+    int stale;         // refill before the next query
+};
+
+// Same order as the rating index (rating, then ISBN), read from the top or
+// from the bottom
+static int ranksAbove(const Book *a, const Book *b, int highest){
+    if (!highest){
+        const Book *swap = a;
+        a = b;
+        b = swap;
+    }
+    return a->rating > b->rating || (a->rating == b->rating && a->isbn > b->isbn);
+}
+
+// ============= BOUNDED HEAP =============
+
+// The heap root is the weakest book kept so far, so a newcomer only has to
+// beat the root to get in
+
+static void siftDown(Book **heap, size_t n, size_t i, int highest){
+    Book *book = heap[i];
+    while (2 * i + 1 < n){
+        size_t child = 2 * i + 1;
+        if (child + 1 < n && ranksAbove(heap[child], heap[child + 1], highest)) child++;
+        if (!ranksAbove(book, heap[child], highest)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = book;
+}
+
+static void siftUp(Book **heap, size_t i, int highest){
+    Book *book = heap[i];
+    while (i){
+        size_t parent = (i - 1) / 2;
+        if (!ranksAbove(heap[parent], book, highest)) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = book;
+}
+
+static void offerList(const BookList *list, Book **heap, size_t *n, size_t k, int highest){
+    for (Book *temp = list->head; temp; temp = temp->next){
+        if (*n < k){
+            heap[*n] = temp;
+            siftUp(heap, (*n)++, highest);
+        }
+        else if (ranksAbove(temp, heap[0], highest)){
+            heap[0] = temp;
+            siftDown(heap, k, 0, highest);
+        }
+    }
+}
+
+// One streaming pass over the chosen lists, then a heap sort of the k kept
+static int selectBooks(Library *lib, char choice, size_t k, int highest, Book ***results, size_t *count){
+    size_t total = choice ? countBooks(getCurrentList(lib, choice)) : lib->index.count;
+    if (k > total) k = total;
+    *results = NULL;
+    *count = 0;
+    if (!k) return 1;
+
+    Book **heap = malloc(k * sizeof(Book *));
+    if (!heap) return 0;
+    STATS_BYTES(k * sizeof(Book *));
+
+    size_t n = 0;
+    if (choice){
+        offerList(getCurrentList(lib, choice), heap, &n, k, highest);
+    }
+    else{
+        offerList(&lib->main_list, heap, &n, k, highest);
+        for (int i = 0; i < lib->bucket_count; i++) offerList(&lib->buckets[i], heap, &n, k, highest);
+    }
+
+    // Each step moves the weakest remaining book to the back, leaving best first
+    for (size_t end = n; end > 1; end--){
+        Book *weakest = heap[0];
+        heap[0] = heap[end - 1];
+        heap[end - 1] = weakest;
+        siftDown(heap, end - 1, 0, highest);
+    }
+    *results = heap;
+    *count = n;
+    return 1;
+}
+
+// ============= LIVE CACHE =============
+
+// First position whose book does not outrank book: its own slot when cached
+static size_t findRank(const TopCache *cache, const Book *book){
+    size_t lo = 0, hi = cache->count;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (ranksAbove(cache->books[mid], book, 1)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int refillCache(Library *lib, TopCache *cache){
+    Book **books;
+    size_t count;
+    if (!selectBooks(lib, 0, cache->capacity, 1, &books, &count)) return 0;
+    free(cache->books);
+    cache->books = books;
+    cache->count = count;
+    cache->allocated = count;
+    cache->complete = count < cache->capacity;
+    cache->stale = 0;
+    return 1;
+}
+
+void topCacheAdd(TopCache *cache, Book *book){
+    if (cache->stale) return;
+
+    size_t pos = findRank(cache, book);
+    if (pos == cache->count && (!cache->complete || cache->count == cache->capacity)){
+        // Weaker than everything kept, and an uncached book may outrank it
+        cache->complete = 0;
+        return;
+    }
+    if (cache->count == cache->capacity){
+        cache->count--;  // the weakest book falls out
+        cache->complete = 0;
+    }
+    if (cache->count == cache->allocated){
+        size_t allocated = cache->allocated ? cache->allocated * 2 : TOP_CACHE_MIN_SLACK;
+        if (allocated > cache->capacity) allocated = cache->capacity;
+        Book **books = realloc(cache->books, allocated * sizeof(Book *));
+        if (!books){
+            cache->stale = 1;
+            return;
+        }
+        STATS_BYTES((allocated - cache->allocated) * sizeof(Book *));
+        cache->books = books;
+        cache->allocated = allocated;
+    }
+    memmove(cache->books + pos + 1, cache->books + pos, (cache->count - pos) * sizeof(Book *));
+    cache->books[pos] = book;
+    cache->count++;
+}
+
+void topCacheRemove(TopCache *cache, const Book *book){
+    if (cache->stale) return;
+
+    size_t pos = findRank(cache, book);
+    if (pos == cache->count || cache->books[pos] != book) return;
+    memmove(cache->books + pos, cache->books + pos + 1, (cache->count - pos - 1) * sizeof(Book *));
+    cache->count--;
+    if (!cache->complete && cache->count < cache->k) cache->stale = 1;
+}
+
+void topCacheInvalidate(TopCache *cache){
+    if (cache) cache->stale = 1;
+}
+
+void destroyTopCache(TopCache *cache){
+    if (!cache) return;
+    free(cache->books);
+    free(cache);
+}
+
+int setTopCache(Library *lib, size_t k){
+    STATS_SCOPE(STAT_TOP);
+    destroyTopCache(lib->top);
+    lib->top = NULL;
+    if (!k) return 1;
+
+    TopCache *cache = calloc(1, sizeof(TopCache));
+    if (!cache) return 0;
+    STATS_BYTES(sizeof(TopCache));
+    size_t slack = k < TOP_CACHE_MIN_SLACK ? TOP_CACHE_MIN_SLACK : k;
+    cache->k = k;
+    cache->capacity = k > (size_t)-1 - slack ? (size_t)-1 : k + slack;
+    if (!refillCache(lib, cache)){
+        free(cache);
+        return 0;
+    }
+    lib->top = cache;
+    return 1;
+}
+
+size_t topCacheSize(const Library *lib){
+    return lib->top ? lib->top->k : 0;
+}
+
+// ============= QUERIES =============
+
+int topRatedBooks(Library *lib, char choice, size_t k, int highest, Book ***results, size_t *count){
+    STATS_SCOPE(STAT_TOP);
+    TopCache *cache = lib->top;
+    if (!choice && highest && cache && k <= cache->k && (!cache->stale || refillCache(lib, cache))){
+        size_t n = k < cache->count ? k : cache->count;
+        *results = NULL;
+        *count = 0;
+        if (!n) return 1;
+        *results = malloc(n * sizeof(Book *));
+        if (!*results) return 0;
+        STATS_BYTES(n * sizeof(Book *));
+        memcpy(*results, cache->books, n * sizeof(Book *));
+        *count = n;
+        return 1;
+    }
+    return selectBooks(lib, choice, k, highest, results, count);
+}
@@ -0,0 +1,30 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stddef.h>
+#include "book.h"
+
+// Optional live cache of the best-rated books across the whole library. Once
+// enabled it is kept up to date by book.c on every insert and delete.
+typedef struct TopCache TopCache;
+
+// The k highest (highest != 0) or lowest rated books in list 'm' or a bucket
+// ('a', 'b', ...), or in every list when choice is 0, best first. Ties follow
+// the rating index order: by ISBN, descending for top queries and ascending
+// for bottom ones. One pass through a bounded heap, O(n log k); the lists are
+// not reordered. *results is a malloc'd array of *count books (NULL when there
+// are none). Returns 0 only when memory runs out.
+int topRatedBooks(Library *lib, char choice, size_t k, int highest, Book ***results, size_t *count);
+
+// Keeps the top k of the whole library ready for topRatedBooks; 0 turns the
+// cache off. Returns 0 only when memory runs out, leaving the cache off.
+int setTopCache(Library *lib, size_t k);
+size_t topCacheSize(const Library *lib);  // 0 when off
+
+// Mutation hooks called by book.c
+void topCacheAdd(TopCache *cache, Book *book);
+void topCacheRemove(TopCache *cache, const Book *book);
+void topCacheInvalidate(TopCache *cache);  // contents replaced wholesale
+void destroyTopCache(TopCache *cache);
+
+#endif // TOPK_H